@@ -1,25 +1,139 @@
-
 #!/bin/bash
 
-mkdir -p dist
-mkdir -p build
+# usage: ./build.sh [debug|release|lto|pgo|test|clean]
+#
+#   debug    -O0 -g (default)
+#   release  -O$OLEVEL (default 3) -march=$MARCH (default native, MARCH= leaves it out)
+#   lto      release with link time optimization
+#   pgo      lto with profile guided optimization: builds an instrumented
+#            binary, trains it on the headless benchmark (every scene for
+#            PGO_FRAMES frames, then the scene 4 workloads below) and
+#            rebuilds with the profile
+#   test     release, then runs the self-test (lighting self-test, see
+#            src/selftest.h)
+#
+# Objects are kept per configuration in build/<config>/ and only recompiled
+# when their source, a header they include (gcc -MMD dep files) or the flags
+# changed. The binary is copied to dist/lighting.
 
-rm dist/* 2> /dev/null
-rm build/* 2> /dev/null
+set -e
 
-OLEVEL="0"
-CFLAGS="-fstrict-aliasing -Wall -Wextra -Wfloat-equal -Wno-unused-variable -pedantic -Wno-unused-parameter -g -O0"
-CC="gcc"
+CONFIG="${1:-debug}"
+CC="${CC:-gcc}"
+OLEVEL="${OLEVEL:-3}"
+MARCH="${MARCH-native}"
+PGO_FRAMES="${PGO_FRAMES:-120}"
+JOBS="${JOBS:-$(nproc 2> /dev/null || echo 1)}"
 OUT_EXECUTABLE="lighting"
 
-for f in src/*.c; do
-    froot=$(echo $f | awk -F '/' '{print $2}' | awk -F '.' '{print $1}')
-    printf "  building $froot.o ..."
-    $CC $CFLAGS -c src/$froot.c -o build/$froot.o -lSDL2 -lm
-    printf " done\n"
-done
+CFLAGS="-fstrict-aliasing -Wall -Wextra -Wfloat-equal -Wno-unused-variable -pedantic -Wno-unused-parameter -g"
+LDLIBS="-lSDL2 -lm"
+
+# PGO training runs, on top of BENCH=1 BENCH_FRAMES=$PGO_FRAMES
+PGO_RUNS=(
+    ""
+    "SCENE=3 SCENE4_EXTRA_LIGHTS=2000"
+    "SCENE=3 SCENE4_EXTRA_LIGHTS=2000 SCENE4_INCREMENTAL=0"
+    "SCENE=3 SCENE4_MASK=adaptive"
+    "SCENE=3 SCENE4_MASK=pixels"
+    "SCENE=3 SCENE4_MASK=accumulate SCENE4_EXTRA_LIGHTS=2000"
+)
+
+OPT_CFLAGS="-O$OLEVEL"
+[ -n "$MARCH" ] && OPT_CFLAGS="$OPT_CFLAGS -march=$MARCH"
+
+case "$CONFIG" in
+    debug)   CFLAGS="$CFLAGS -O0" ;;
+    release|test) CFLAGS="$CFLAGS $OPT_CFLAGS" ;;
+    lto|pgo) CFLAGS="$CFLAGS $OPT_CFLAGS -flto=auto" ;;
+    clean)
+        rm -rf build dist
+        exit 0
+        ;;
+    *)
+        echo "usage: $0 [debug|release|lto|pgo|test|clean]" >&2
+        exit 1
+        ;;
+esac
+
+BUILD_DIR="build/$CONFIG"
+# the test runs the release build
+[ "$CONFIG" = "test" ] && BUILD_DIR="build/release"
+mkdir -p dist "$BUILD_DIR"
+
+is_stale() {
+    # an object is stale if it or its dep file is missing, or anything in the
+    # first rule of the dep file (the source and its headers) is newer.
+    local obj="$1" dep="${1%.o}.d"
+    [ -f "$obj" ] && [ -f "$dep" ] || return 0
+    local deps
+    deps=$(awk '{ more = sub(/\\$/, ""); print } !more { exit }' "$dep" | sed 's/^[^:]*://')
+    for f in $deps; do
+        [ -e "$f" ] && [ ! "$f" -nt "$obj" ] || return 0
+    done
+    return 1
+}
+
+build_objects() {
+    local flags="$1" running=0 failed=0
+    # objects built with other flags are thrown away, profiles are kept
+    if [ "$(cat "$BUILD_DIR/flags" 2> /dev/null)" != "$CC $flags" ]; then
+        rm -f "$BUILD_DIR"/*.o "$BUILD_DIR"/*.d
+        echo "$CC $flags" > "$BUILD_DIR/flags"
+    fi
+    for src in src/*.c; do
+        local obj="$BUILD_DIR/$(basename "$src" .c).o"
+        is_stale "$obj" || continue
+        echo "  building $obj"
+        $CC $flags -MMD -MP -c "$src" -o "$obj" &
+        running=$((running + 1))
+        if [ $running -ge "$JOBS" ]; then
+            wait -n || failed=1
+            running=$((running - 1))
+        fi
+    done
+    while [ $running -gt 0 ]; do
+        wait -n || failed=1
+        running=$((running - 1))
+    done
+    return $failed
+}
+
+link_binary() {
+    # link flags only here; the compile flags are repeated for LTO.
+    local flags="$1" out="$BUILD_DIR/$OUT_EXECUTABLE" objs=() relink=0
+    for src in src/*.c; do
+        objs+=("$BUILD_DIR/$(basename "$src" .c).o")
+        [ "${objs[-1]}" -nt "$out" ] && relink=1
+    done
+    if [ $relink -eq 1 ] || [ ! -f "$out" ]; then
+        echo "  linking $out"
+        $CC $flags "${objs[@]}" -o "$out" $LDLIBS
+    fi
+}
+
+if [ "$CONFIG" = "pgo" ]; then
+    GEN_FLAGS="$CFLAGS -fprofile-generate -fprofile-update=prefer-atomic"
+    build_objects "$GEN_FLAGS"
+    link_binary "$GEN_FLAGS"
+    # .gcda profiles land next to the objects and are read back from there
+    rm -f "$BUILD_DIR"/*.gcda
+    : > "$BUILD_DIR/training.log"
+    for run in "${PGO_RUNS[@]}"; do
+        echo "  training: BENCH=1 BENCH_FRAMES=$PGO_FRAMES $run"
+        env TEXTURE_CACHE_DIR= BENCH=1 BENCH_FRAMES="$PGO_FRAMES" $run \
+            "./$BUILD_DIR/$OUT_EXECUTABLE" >> "$BUILD_DIR/training.log"
+    done
+    # code the training never reaches is still optimized for speed
+    CFLAGS="$CFLAGS -fprofile-use -fprofile-partial-training -Wno-missing-profile"
+fi
+
+build_objects "$CFLAGS"
+link_binary "$CFLAGS"
+cp "$BUILD_DIR/$OUT_EXECUTABLE" "dist/$OUT_EXECUTABLE"
 
-printf "  building binary... "
-$CC $CFLAGS build/*.o -o dist/$OUT_EXECUTABLE $LIB_ARGS -lSDL2 -lm
+if [ "$CONFIG" = "test" ]; then
+    "./dist/$OUT_EXECUTABLE" self-test
+fi
 
-printf "done!\n"
+printf "done! ($CONFIG)\n"
@@ -3,21 +3,56 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <SDL2/SDL.h>
 
+#include "bench.h"
+#include "commands.h"
 #include "common.h"
+#include "lightfield.h"
+#include "lightshapes.h"
+#include "occluders.h"
+#include "pacer.h"
 #include "scene1.h"
 #include "scene2.h"
 #include "scene3.h"
 #include "scene4.h"
+#include "scenefile.h"
+#include "selftest.h"
+#include "stats.h"
+#include "textures.h"
+#include "workers.h"
 
 #define WINDOW_TITLE "SDL Lighting Test :3"
 #define SCENE_TTL 2000
+// the next scene in the rotation is set up this long before it is shown.
+#define SCENE_PREWARM_MS 250
+#define REPLAY_DEFAULT_DT_MS (1000.0 / 60.0)
 
+/* Scenes are set up on first activation (or prewarmed just before their
+   turn in the rotation) and, with SCENE_IDLE_MS set, cleaned up again once
+   they have not been drawn for that long.
+*/
+typedef struct {
+    const char *name;
+    bool (*setup)(void);
+    void (*cleanup)(void);
+    void (*draw)(const DLE_FrameClock *clock);
+    bool ready;
+    u32 last_active; // clock time of the last draw or prewarm
+} DLE_Scene;
+
+static DLE_Scene scenes[] = {
+    {"scene1", scene_1_setup, scene_1_cleanup, scene_1_draw, false, 0},
+    {"scene2", scene_2_setup, scene_2_cleanup, scene_2_draw, false, 0},
+    {"scene3", scene_3_setup, scene_3_cleanup, scene_3_draw, false, 0},
+    {"scene4", scene_4_setup, scene_4_cleanup, scene_4_draw, false, 0},
+};
+static const u32 total_scene_count = sizeof(scenes) / sizeof(scenes[0]);
 static int target_scene_ix = -1;
-static const u32 total_scene_count = 4;
+static u32 scene_idle_ms = 0; // 0 = never release
 
 static bool check_for_exit(void) {
     // return true if program should exit
@@ -31,41 +66,153 @@ static bool check_for_exit(void) {
     return false;
 }
 
-static void loop(bool *quit) {
+static bool activate_scene(const u32 scene_ix, const u32 now) {
+    // Sets the scene up if it isn't yet. Returns false if setup failed.
+    DLE_Scene *scene = &scenes[scene_ix];
+    scene->last_active = now;
+    if(scene->ready)
+        return true;
+    const u64 start = SDL_GetPerformanceCounter();
+    bool ok = true;
+    prof_zone("scene_setup") {
+        ok = scene->setup();
+    }
+    if(!ok) {
+        fprintf(stderr, "%s setup failed\n", scene->name);
+        // cleanups tolerate partial setups
+        scene->cleanup();
+        return false;
+    }
+    scene->ready = true;
+    printf("%s ready in %.1f ms, textures: %u resident, %.1f MB\n",
+        scene->name,
+        (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency(),
+        textures_resident_count(), textures_resident_bytes() / (1024.0 * 1024.0));
+    return true;
+}
+
+static void release_idle_scenes(const u32 now) {
+    if(!scene_idle_ms)
+        return;
+    for(u32 i = 0; i < total_scene_count; i++) {
+        DLE_Scene *scene = &scenes[i];
+        if(scene->ready && now - scene->last_active > scene_idle_ms) {
+            scene->cleanup();
+            scene->ready = false;
+        }
+    }
+}
+
+static void cleanup_scenes(void) {
+    for(u32 i = 0; i < total_scene_count; i++) {
+        if(scenes[i].ready)
+            scenes[i].cleanup();
+        scenes[i].ready = false;
+    }
+}
+
+static bool draw_scene(const u32 scene_ix, const DLE_FrameClock *clock) {
+    // returns false if scene_ix is not a valid scene or its setup failed.
+    if(scene_ix >= total_scene_count) {
+        fprintf(stderr, "unexpected scene_ix\n");
+        return false;
+    }
+    if(!activate_scene(scene_ix, clock->now))
+        return false;
+    prof_zone("frame") {
+        scenes[scene_ix].draw(clock);
+    }
+    return true;
+}
+
+static void loop(bool *quit, DLE_FrameClock *clock) {
     if(check_for_exit()) {
         *quit = true;
         return;
     }
+    frame_clock_tick(clock);
     const u32
-        now = SDL_GetTicks();
+        now = clock->now;
     const u32 scene_ix = target_scene_ix >= 0 ? U32(target_scene_ix) :(now / SCENE_TTL) % total_scene_count;
-    switch(scene_ix) {
-        case 0:
-            scene_1_draw();
-            break;
-        case 1:
-            scene_2_draw();
-            break;
-        case 2:
-            scene_3_draw();
-            break;
-        case 3:
-            scene_4_draw();
-            break;
-        default:
-            fprintf(stderr, "unexpected scene_ix\n");
+    if(!draw_scene(scene_ix, clock)) {
+        *quit = true;
+        return;
+    }
+    // prewarm the next scene after presenting, so the setup cost lands in
+    // this scene's last frames instead of the switch.
+    if(target_scene_ix < 0 && now % SCENE_TTL >= SCENE_TTL - SCENE_PREWARM_MS) {
+        if(!activate_scene((scene_ix + 1) % total_scene_count, now))
             *quit = true;
-            return;
     }
+    release_idle_scenes(now);
+}
+
+static bool run_benchmark(
+    const u32 frames,
+    const f64 fixed_dt_ms,
+    const DLE_BenchFormat format,
+    FILE *out
+) {
+    // Runs each scene (or only SCENE) for `frames` warmup frames followed by
+    // `frames` measured frames. Every scene starts from a fresh fixed-step
+    // clock so repeated runs render identical frames.
+    // Returns false if the run was interrupted.
+    u64 *samples = malloc(sizeof(u64) * frames);
+    if(!samples) {
+        fprintf(stderr, "%s failed to allocate samples\n", __func__);
+        return false;
+    }
+
+    bool ok = true;
+    const u32 first_scene_ix = target_scene_ix >= 0 ? U32(target_scene_ix) : 0;
+    const u32 last_scene_ix = target_scene_ix >= 0 ? U32(target_scene_ix) : total_scene_count - 1;
+    // set up before the report starts, so setup output doesn't end up inside it.
+    for(u32 scene_ix = first_scene_ix; ok && scene_ix <= last_scene_ix; scene_ix++)
+        ok = activate_scene(scene_ix, 0);
+    bench_report_begin(out, format);
+    for(u32 scene_ix = first_scene_ix; ok && scene_ix <= last_scene_ix; scene_ix++) {
+        DLE_FrameClock clock;
+        frame_clock_init(&clock, fixed_dt_ms);
+        for(u32 i = 0; ok && i < frames * 2; i++) {
+            if(check_for_exit()) {
+                ok = false;
+                break;
+            }
+            frame_clock_tick(&clock);
+            const u64 start = SDL_GetPerformanceCounter();
+            if(!draw_scene(scene_ix, &clock)) {
+                ok = false;
+                break;
+            }
+            const u64 end = SDL_GetPerformanceCounter();
+            if(i >= frames)
+                samples[i - frames] = end - start;
+        }
+        if(!ok)
+            break;
+
+        DLE_BenchStats stats;
+        bench_compute_stats(samples, frames, &stats);
+        bench_report_scene(out, format, scenes[scene_ix].name, &stats, scene_ix == first_scene_ix);
+    }
+    bench_report_end(out, format);
+
+    free(samples);
+    return ok;
 }
 
-static bool setup(bool use_vsync) {
+static bool setup(bool use_vsync, bool headless) {
     // returns true if setup is successful.
 
     srand(time(NULL));
 
     /* setup SDL
     */
+    if(headless) {
+        // SDL_VIDEODRIVER/SDL_RENDER_DRIVER in the environment still take precedence.
+        SDL_SetHint("SDL_VIDEODRIVER", "dummy");
+        SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+    }
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
         return false;
@@ -75,7 +222,7 @@ static bool setup(bool use_vsync) {
         WINDOW_TITLE,
         SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
         WINDOW_WIDTH, WINDOW_HEIGHT,
-        SDL_WINDOW_SHOWN);
+        headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN);
     if(!w) {
         fprintf(stderr, "Window could not be created! SDL_Error: %s\n", SDL_GetError());
         return false;
@@ -84,49 +231,97 @@ static bool setup(bool use_vsync) {
     r = SDL_CreateRenderer(
         w,
         -1,
-        (SDL_RENDERER_ACCELERATED | (use_vsync ? SDL_RENDERER_PRESENTVSYNC : 0))
+        headless
+            ? (SDL_RENDERER_SOFTWARE | SDL_RENDERER_TARGETTEXTURE)
+            : (SDL_RENDERER_ACCELERATED | (use_vsync ? SDL_RENDERER_PRESENTVSYNC : 0))
     );
     if(!r) {
         fprintf(stderr, "Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
         return false;
     }
 
-    if(!scene_1_setup()) {
-        fprintf(stderr, "scene_1_setup failed\n");
-        return false;
-    }
-    if(!scene_2_setup()) {
-        fprintf(stderr, "scene_2_setup failed\n");
-        return false;
-    }
-    if(!scene_3_setup()) {
-        fprintf(stderr, "scene_3_setup failed\n");
-        return false;
-    }
-    if(!scene_4_setup()) {
-        fprintf(stderr, "scene_4_setup failed\n");
-        return false;
-    }
+    // scenes are set up on first use, see activate_scene.
 
     return true;
 }
 
-static inline char get_loading_char(const u32 now) {
-    char working_chars[] = {'|', '/', '-', '\\'};
-    const  u32 ix = (now >> 6) % sizeof(working_chars);
-    return working_chars[ix];
-}
 
 
 
 
 int main(int argc, char **argv) {
     int exit_code = 0;
+    if(argc > 1 && strcmp(argv[1], "convert-scene") == 0) {
+        // lighting convert-scene in.txt out.scene writes a binary scene file.
+        if(argc != 4) {
+            fprintf(stderr, "usage: %s convert-scene in.txt out.scene\n", argv[0]);
+            return 1;
+        }
+        return scene_file_convert(argv[2], argv[3]) ? 0 : 1;
+    }
+    if(argc > 1 && strcmp(argv[1], "self-test") == 0) {
+        // lighting self-test checks the optimized paths, see selftest.h.
+        return self_test_run() ? 0 : 1;
+    }
     printf("Hello!\nPress ESC to close.\n");
 
     // Parse env.
+    // cleanup_and_exit closes these, declared before the first jump to it
+    FILE *bench_out = stdout;
+    FILE *fps_log = NULL;
     const bool use_vsync = getenv("USE_VSYNC") != NULL;
     printf("use vsync: %u\n", use_vsync);
+    const bool bench = getenv("BENCH") != NULL;
+    // REPLAY_DT_MS steps a fixed simulated dt per frame instead of wall time.
+    // Benchmarks always replay (defaulting to 60 steps per second).
+    f64 replay_dt_ms = bench ? REPLAY_DEFAULT_DT_MS : 0;
+    {
+        const char *replay_dt_data = getenv("REPLAY_DT_MS");
+        if(replay_dt_data) {
+            const f64 replay_dt_val = atof(replay_dt_data);
+            if(replay_dt_val <= 0) {
+                fprintf(stderr, "REPLAY_DT_MS env variable is invalid\n");
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+            replay_dt_ms = replay_dt_val;
+        }
+    }
+    if(replay_dt_ms > 0)
+        printf("replay dt: %f ms\n", replay_dt_ms);
+    u32 bench_frames = BENCH_DEFAULT_FRAMES;
+    DLE_BenchFormat bench_format = BENCH_FORMAT_CSV;
+    if(bench) {
+        const char *bench_frames_data = getenv("BENCH_FRAMES");
+        if(bench_frames_data) {
+            const int bench_frames_val = atoi(bench_frames_data);
+            if(bench_frames_val <= 0) {
+                fprintf(stderr, "BENCH_FRAMES env variable is invalid\n");
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+            bench_frames = U32(bench_frames_val);
+        }
+        const char *bench_format_data = getenv("BENCH_FORMAT");
+        if(bench_format_data && strcmp(bench_format_data, "json") == 0)
+            bench_format = BENCH_FORMAT_JSON;
+        else if(bench_format_data && strcmp(bench_format_data, "csv") != 0) {
+            fprintf(stderr, "BENCH_FORMAT env variable is invalid\n");
+            exit_code = 1;
+            goto cleanup_and_exit;
+        }
+        const char *bench_out_path = getenv("BENCH_OUT");
+        if(bench_out_path) {
+            bench_out = fopen(bench_out_path, "w");
+            if(!bench_out) {
+                fprintf(stderr, "could not open BENCH_OUT %s\n", bench_out_path);
+                bench_out = stdout;
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+        }
+        printf("benchmark: %u warmup + %u measured frames per scene\n", bench_frames, bench_frames);
+    }
     {
         const char *target_scene_ix_data = getenv("SCENE");
         if(target_scene_ix_data) {
@@ -141,43 +336,198 @@ int main(int argc, char **argv) {
         }
     }
 
-    if(!setup(use_vsync)) {
+    {
+        // TEXTURE_CACHE_DIR=path caches generated textures there instead of
+        // SDL's per-user pref path, TEXTURE_CACHE_DIR= (empty) disables it.
+        if(!textures_init_cache(getenv("TEXTURE_CACHE_DIR"))) {
+            exit_code = 1;
+            goto cleanup_and_exit;
+        }
+    }
+
+    {
+        // SCENE_FILE=path maps a binary scene file: its lights replace scene
+        // 4's, its occluders are added to scenes 2 and 3.
+        const char *scene_file_path = getenv("SCENE_FILE");
+        if(scene_file_path) {
+            if(!scene_file_open(scene_file_path)) {
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+            const DLE_SceneFile *file = scene_file();
+            printf("scene file: %s (%u lights, %u segments)\n",
+                scene_file_path, file->lights.count, file->segment_count);
+        }
+    }
+
+    {
+        // SCENE_IDLE_MS=n cleans up scenes that have not been drawn for n ms.
+        const char *scene_idle_data = getenv("SCENE_IDLE_MS");
+        if(scene_idle_data) {
+            const int scene_idle_val = atoi(scene_idle_data);
+            if(scene_idle_val < 0) {
+                fprintf(stderr, "SCENE_IDLE_MS env variable is invalid\n");
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+            scene_idle_ms = U32(scene_idle_val);
+        }
+    }
+
+    {
+        // MASK_SCALE=1|2|4|8 divides the light mask resolution.
+        const char *mask_scale_data = getenv("MASK_SCALE");
+        if(mask_scale_data) {
+            const int mask_scale_val = atoi(mask_scale_data);
+            if(mask_scale_val <= 0 || mask_scale_val > MASK_SCALE_MAX || (mask_scale_val & (mask_scale_val - 1))) {
+                fprintf(stderr, "MASK_SCALE env variable is invalid\n");
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+            mask_scale = U32(mask_scale_val);
+        }
+        printf("mask scale: 1/%u\n", mask_scale);
+    }
+
+    {
+        // LIGHT_KERNEL=reference|scalar|fixed|sse2|avx2 overrides runtime CPU dispatch.
+        if(!light_field_select_kernel(getenv("LIGHT_KERNEL"))) {
+            fprintf(stderr, "LIGHT_KERNEL env variable is invalid\n");
+            exit_code = 1;
+            goto cleanup_and_exit;
+        }
+        printf("light kernel: %s\n", light_field_kernel_name());
+    }
+
+    {
+        // TRACE_OUT=path records scoped zones and writes a Chrome trace on exit.
+        const char *trace_path = getenv("TRACE_OUT");
+        if(trace_path && !prof_init(trace_path)) {
+            exit_code = 1;
+            goto cleanup_and_exit;
+        }
+    }
+
+    {
+        // WORKERS=n light field worker threads besides the render thread.
+        // Defaults to one per remaining core.
+        const int cpu_count = SDL_GetCPUCount();
+        u32 worker_count = cpu_count > 1 ? U32(cpu_count - 1) : 0;
+        const char *worker_count_data = getenv("WORKERS");
+        if(worker_count_data) {
+            const int worker_count_val = atoi(worker_count_data);
+            if(worker_count_val < 0 || worker_count_val > WORKERS_MAX) {
+                fprintf(stderr, "WORKERS env variable is invalid\n");
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+            worker_count = U32(worker_count_val);
+        }
+        if(!workers_start(worker_count)) {
+            exit_code = 1;
+            goto cleanup_and_exit;
+        }
+        printf("worker threads: %u\n", worker_count);
+    }
+
+    if(!setup(use_vsync, bench)) {
         fprintf(stderr, "setup failed!\n");
         exit_code = 1;
         goto cleanup_and_exit;
     }
 
+    if(bench) {
+        if(!run_benchmark(bench_frames, replay_dt_ms, bench_format, bench_out))
+            exit_code = 1;
+        goto cleanup_and_exit;
+    }
+
+    {
+        // FPS_REPORT_MS sets the reporter interval, FPS_LOG=path appends reports to a file.
+        u32 report_interval_ms = STATS_DEFAULT_REPORT_INTERVAL_MS;
+        const char *report_interval_data = getenv("FPS_REPORT_MS");
+        if(report_interval_data) {
+            const int report_interval_val = atoi(report_interval_data);
+            if(report_interval_val <= 0) {
+                fprintf(stderr, "FPS_REPORT_MS env variable is invalid\n");
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+            report_interval_ms = U32(report_interval_val);
+        }
+        const char *fps_log_path = getenv("FPS_LOG");
+        if(fps_log_path) {
+            fps_log = fopen(fps_log_path, "a");
+            if(!fps_log) {
+                fprintf(stderr, "could not open FPS_LOG %s\n", fps_log_path);
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+        }
+        if(!stats_start(report_interval_ms, fps_log)) {
+            exit_code = 1;
+            goto cleanup_and_exit;
+        }
+    }
+    // TARGET_FPS paces the loop instead of running flat out. PACER_SPIN_US
+    // is how long before each deadline the pacer stops sleeping and spins.
+    DLE_FramePacer pacer = {0};
+    f64 target_fps = 0;
+    {
+        const char *target_fps_data = getenv("TARGET_FPS");
+        if(target_fps_data) {
+            target_fps = atof(target_fps_data);
+            if(target_fps <= 0) {
+                fprintf(stderr, "TARGET_FPS env variable is invalid\n");
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+        }
+        f64 spin_us = PACER_DEFAULT_SPIN_US;
+        const char *spin_us_data = getenv("PACER_SPIN_US");
+        if(spin_us_data) {
+            spin_us = atof(spin_us_data);
+            if(spin_us < 0) {
+                fprintf(stderr, "PACER_SPIN_US env variable is invalid\n");
+                exit_code = 1;
+                goto cleanup_and_exit;
+            }
+        }
+        if(target_fps > 0) {
+            frame_pacer_init(&pacer, target_fps, spin_us);
+            printf("target fps: %f, spin %f us\n", target_fps, spin_us);
+        }
+    }
+
 
     bool quit = false;
-    u32 fps_measurement_count = 0;
-    f64 fps_sum = 0;
-    u32 fps = 0;
-    u32 last_fps_measurement_ts = SDL_GetTicks();
-    u32 last_fps_measurement_value = 0;
+    DLE_FrameClock clock;
+    frame_clock_init(&clock, replay_dt_ms);
     while (!quit) {
-        loop(&quit);
-        fps++;
-        const u32 now = SDL_GetTicks();
-        if((now - last_fps_measurement_ts) > 1000) {
-            printf("%c current FPS: %u  \r", get_loading_char(now), fps);
-            fps_sum += fps;
-            fps_measurement_count++;
-            last_fps_measurement_value = fps;
-            fps = 0;
-            last_fps_measurement_ts = now;
-        } else {
-            printf("%c current FPS: %u  \r", get_loading_char(now), last_fps_measurement_value);
-        }
-        fflush(stdout);
-    }
-    printf("avg FPS: %f\n", fps_sum / fps_measurement_count);
+        loop(&quit, &clock);
+        if(target_fps > 0)
+            frame_pacer_wait(&pacer);
+        stats_push_frame(SDL_GetPerformanceCounter());
+    }
+    if(target_fps > 0)
+        frame_pacer_report(&pacer);
 
     cleanup_and_exit:
     printf("preparing to exit\n");
-    scene_1_cleanup();
-    scene_2_cleanup();
-    scene_3_cleanup();
-    scene_4_cleanup();
+    cleanup_scenes();
+    scene_file_close();
+    commands_free();
+    light_shapes_free();
+    occluders_sweep_free();
+    textures_shutdown_cache();
+    workers_stop();
+    prof_shutdown();
+
+    stats_stop();
+    if(bench_out != stdout)
+        fclose(bench_out);
+    if(fps_log)
+        fclose(fps_log);
 
     if(w) {
         SDL_DestroyWindow(w);
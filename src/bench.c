@@ -0,0 +1,75 @@
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+
+static int compare_u64(const void *a, const void *b) {
+    const u64 va = *(const u64*)a, vb = *(const u64*)b;
+    return (va > vb) - (va < vb);
+}
+
+static inline f64 percentile(const u64 *sorted, const u32 count, const f64 p) {
+    // nearest-rank method
+    u32 rank = U32(ceil(p / 100.0 * count));
+    if(rank < 1) rank = 1;
+    if(rank > count) rank = count;
+    return F64(sorted[rank - 1]);
+}
+
+void bench_compute_stats(u64 *samples, const u32 count, DLE_BenchStats *stats) {
+    *stats = (DLE_BenchStats) {0};
+    if(!count)
+        return;
+
+    qsort(samples, count, sizeof(u64), compare_u64);
+
+    const f64 ticks_to_ms = 1000.0 / F64(SDL_GetPerformanceFrequency());
+    f64 sum = 0;
+    for(u32 i = 0; i < count; i++)
+        sum += F64(samples[i]);
+
+    stats->frames = count;
+    stats->min_ms = F64(samples[0]) * ticks_to_ms;
+    stats->mean_ms = sum / count * ticks_to_ms;
+    stats->p50_ms = percentile(samples, count, 50) * ticks_to_ms;
+    stats->p95_ms = percentile(samples, count, 95) * ticks_to_ms;
+    stats->p99_ms = percentile(samples, count, 99) * ticks_to_ms;
+    stats->max_ms = F64(samples[count - 1]) * ticks_to_ms;
+}
+
+void bench_report_begin(FILE *out, const DLE_BenchFormat format) {
+    if(format == BENCH_FORMAT_JSON)
+        fprintf(out, "[\n");
+    else
+        fprintf(out, "scene,frames,min_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+}
+
+void bench_report_scene(
+    FILE *out,
+    const DLE_BenchFormat format,
+    const char *scene_name,
+    const DLE_BenchStats *stats,
+    const bool first
+) {
+    if(format == BENCH_FORMAT_JSON) {
+        fprintf(out,
+            "%s  {\"scene\": \"%s\", \"frames\": %u, \"min_ms\": %.4f, \"mean_ms\": %.4f, "
+            "\"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}",
+            first ? "" : ",\n",
+            scene_name, stats->frames, stats->min_ms, stats->mean_ms,
+            stats->p50_ms, stats->p95_ms, stats->p99_ms, stats->max_ms);
+    } else {
+        fprintf(out, "%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+            scene_name, stats->frames, stats->min_ms, stats->mean_ms,
+            stats->p50_ms, stats->p95_ms, stats->p99_ms, stats->max_ms);
+    }
+    fflush(out);
+}
+
+void bench_report_end(FILE *out, const DLE_BenchFormat format) {
+    if(format == BENCH_FORMAT_JSON)
+        fprintf(out, "\n]\n");
+    fflush(out);
+}
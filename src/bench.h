@@ -0,0 +1,41 @@
+
+#ifndef lighting_example_bench_H
+#define lighting_example_bench_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "common.h"
+
+
+#define BENCH_DEFAULT_FRAMES 300
+
+typedef enum {
+    BENCH_FORMAT_CSV,
+    BENCH_FORMAT_JSON,
+} DLE_BenchFormat;
+
+typedef struct {
+    u32 frames;
+    f64 min_ms;
+    f64 mean_ms;
+    f64 p50_ms;
+    f64 p95_ms;
+    f64 p99_ms;
+    f64 max_ms;
+} DLE_BenchStats;
+
+// Sorts samples in place. Samples are SDL_GetPerformanceCounter deltas.
+void bench_compute_stats(u64 *samples, const u32 count, DLE_BenchStats *stats);
+
+void bench_report_begin(FILE *out, const DLE_BenchFormat format);
+void bench_report_scene(
+    FILE *out,
+    const DLE_BenchFormat format,
+    const char *scene_name,
+    const DLE_BenchStats *stats,
+    const bool first
+);
+void bench_report_end(FILE *out, const DLE_BenchFormat format);
+
+#endif
@@ -0,0 +1,325 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "commands.h"
+
+
+typedef enum {
+    COMMAND_FILL,
+    COMMAND_COPY,
+    COMMAND_GEOMETRY,
+    COMMAND_GEOMETRY_REF,
+} DLE_CommandKind;
+
+typedef struct {
+    DLE_Layer layer;
+    SDL_Texture *target;
+    SDL_BlendMode blend;
+    u32 seq; // recording order, keeps the sort stable
+    u32 target_pass; // first pass recorded for its layer and target
+    u32 pass;        // pass of its layer, target and blend
+    const char *stage; // zone that recorded it (prof_current_zone)
+    DLE_CommandKind kind;
+    SDL_Color color;          // fill
+    SDL_FRect rect;           // fill, copy
+    bool whole_target;        // copy
+    SDL_Texture *texture;     // copy
+    const SDL_Vertex *verts;  // geometry_ref
+    const int *indices;       // geometry_ref
+    u32 vert_count;           // geometry, geometry_ref
+    u32 first_index;          // geometry
+    u32 index_count;          // geometry, geometry_ref
+} DLE_Command;
+
+static DLE_Command *commands = NULL;
+static u32 command_count = 0;
+static u32 command_capacity = 0;
+static DLE_Geometry geometry = {0}; // copied geometry, indices are absolute
+static DLE_Geometry batch = {0};    // index scratch for coalesced runs
+static SDL_FRect *fill_rects = NULL;
+static u32 fill_rect_capacity = 0;
+
+/* Passes are the (layer, target, blend) keys in the order they were first
+   recorded. The flush goes by pass instead of by the key's values, so on a
+   target a clear recorded before its draws goes first whatever the blend
+   modes and texture addresses are.
+*/
+#define COMMANDS_MAX_PASSES 64
+
+typedef struct {
+    DLE_Layer layer;
+    SDL_Texture *target;
+    SDL_BlendMode blend;
+} DLE_CommandPass;
+
+static DLE_CommandPass passes[COMMANDS_MAX_PASSES];
+static u32 pass_count = 0;
+
+static bool assign_pass(DLE_Command *command) {
+    // returns false if there are too many passes.
+    u32 target_pass = pass_count;
+    for(u32 i = 0; i < pass_count; i++) {
+        const DLE_CommandPass *pass = &passes[i];
+        if(pass->layer != command->layer || pass->target != command->target)
+            continue;
+        target_pass = target_pass < i ? target_pass : i;
+        if(pass->blend != command->blend)
+            continue;
+        command->target_pass = target_pass;
+        command->pass = i;
+        return true;
+    }
+    if(pass_count == COMMANDS_MAX_PASSES) {
+        fprintf(stderr, "%s more than %u passes\n", __func__, COMMANDS_MAX_PASSES);
+        return false;
+    }
+    passes[pass_count] = (DLE_CommandPass){ command->layer, command->target, command->blend };
+    command->target_pass = target_pass;
+    command->pass = pass_count++;
+    return true;
+}
+
+static DLE_Command *push_command(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend, const DLE_CommandKind kind
+) {
+    // returns NULL if the buffer could not grow.
+    if(command_count == command_capacity) {
+        const u32 capacity = command_capacity ? command_capacity * 2 : 64;
+        DLE_Command *grown = realloc(commands, sizeof(DLE_Command) * capacity);
+        if(!grown) {
+            fprintf(stderr, "%s failed to grow to %u commands\n", __func__, capacity);
+            return NULL;
+        }
+        commands = grown;
+        command_capacity = capacity;
+    }
+    DLE_Command *command = &commands[command_count];
+    *command = (DLE_Command) {
+        .layer = layer,
+        .target = target,
+        .blend = blend,
+        .seq = command_count,
+        .stage = prof_current_zone,
+        .kind = kind,
+    };
+    if(!assign_pass(command))
+        return NULL;
+    command_count++;
+    return command;
+}
+
+bool commands_fill(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend,
+    const SDL_FRect *rect, const SDL_Color color
+) {
+    DLE_Command *command = push_command(layer, target, blend, COMMAND_FILL);
+    if(!command)
+        return false;
+    command->color = color;
+    command->rect = rect ? *rect : (SDL_FRect) {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+    return true;
+}
+
+bool commands_copy(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend,
+    SDL_Texture *texture, const SDL_FRect *dest
+) {
+    DLE_Command *command = push_command(layer, target, blend, COMMAND_COPY);
+    if(!command)
+        return false;
+    command->texture = texture;
+    command->whole_target = !dest;
+    if(dest)
+        command->rect = *dest;
+    return true;
+}
+
+bool commands_geometry(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend,
+    const SDL_Vertex *verts, const u32 vert_count,
+    const int *indices, const u32 index_count
+) {
+    if(!geometry_reserve(&geometry, vert_count, index_count))
+        return false;
+    DLE_Command *command = push_command(layer, target, blend, COMMAND_GEOMETRY);
+    if(!command)
+        return false;
+    const int base = I32(geometry.vert_count);
+    for(u32 i = 0; i < vert_count; i++)
+        geometry.verts[geometry.vert_count++] = verts[i];
+    command->first_index = geometry.index_count;
+    command->index_count = index_count;
+    for(u32 i = 0; i < index_count; i++)
+        geometry.indices[geometry.index_count++] = base + indices[i];
+    return true;
+}
+
+bool commands_geometry_ref(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend,
+    const SDL_Vertex *verts, const u32 vert_count,
+    const int *indices, const u32 index_count
+) {
+    if(!index_count)
+        return true;
+    DLE_Command *command = push_command(layer, target, blend, COMMAND_GEOMETRY_REF);
+    if(!command)
+        return false;
+    command->verts = verts;
+    command->vert_count = vert_count;
+    command->indices = indices;
+    command->index_count = index_count;
+    return true;
+}
+
+static int compare_commands(const void *a, const void *b) {
+    const DLE_Command *ca = a, *cb = b;
+    if(ca->layer != cb->layer)
+        return ca->layer < cb->layer ? -1 : 1;
+    if(ca->target_pass != cb->target_pass)
+        return ca->target_pass < cb->target_pass ? -1 : 1;
+    if(ca->pass != cb->pass)
+        return ca->pass < cb->pass ? -1 : 1;
+    return ca->seq < cb->seq ? -1 : ca->seq > cb->seq;
+}
+
+static inline bool same_state(const DLE_Command *a, const DLE_Command *b) {
+    return a->target == b->target && a->blend == b->blend;
+}
+
+static u32 flush_fills(const u32 first) {
+    // one SDL_RenderFillRectsF per run of same colored fills. Returns the
+    // index after the run.
+    const DLE_Command *head = &commands[first];
+    u32 end = first + 1;
+    while(end < command_count
+        && commands[end].kind == COMMAND_FILL
+        && same_state(&commands[end], head)
+        && commands[end].color.r == head->color.r
+        && commands[end].color.g == head->color.g
+        && commands[end].color.b == head->color.b
+        && commands[end].color.a == head->color.a)
+        end++;
+    const u32 count = end - first;
+    if(count > fill_rect_capacity) {
+        SDL_FRect *grown = realloc(fill_rects, sizeof(SDL_FRect) * count);
+        if(!grown) {
+            fprintf(stderr, "%s failed to grow to %u rects\n", __func__, count);
+            return end;
+        }
+        fill_rects = grown;
+        fill_rect_capacity = count;
+    }
+    for(u32 i = 0; i < count; i++)
+        fill_rects[i] = commands[first + i].rect;
+    SDL_SetRenderDrawColor(r, head->color.r, head->color.g, head->color.b, head->color.a);
+    SDL_RenderFillRectsF(r, fill_rects, I32(count));
+    return end;
+}
+
+static u32 flush_geometry(const u32 first) {
+    // one SDL_RenderGeometry per run of copied geometry. Returns the index
+    // after the run.
+    const DLE_Command *head = &commands[first];
+    u32 end = first + 1;
+    u32 index_count = head->index_count;
+    while(end < command_count
+        && commands[end].kind == COMMAND_GEOMETRY
+        && same_state(&commands[end], head)) {
+        index_count += commands[end].index_count;
+        end++;
+    }
+    if(end == first + 1) {
+        SDL_RenderGeometry(
+            r, NULL,
+            geometry.verts, I32(geometry.vert_count),
+            &geometry.indices[head->first_index], I32(head->index_count));
+        return end;
+    }
+    geometry_clear(&batch);
+    if(!geometry_reserve(&batch, 0, index_count))
+        return end;
+    for(u32 i = first; i < end; i++) {
+        const DLE_Command *command = &commands[i];
+        for(u32 j = 0; j < command->index_count; j++)
+            batch.indices[batch.index_count++] = geometry.indices[command->first_index + j];
+    }
+    SDL_RenderGeometry(
+        r, NULL,
+        geometry.verts, I32(geometry.vert_count),
+        batch.indices, I32(batch.index_count));
+    return end;
+}
+
+void commands_flush(void) {
+    prof_zone("commands_flush") {
+        qsort(commands, command_count, sizeof(DLE_Command), compare_commands);
+        bool first = true;
+        SDL_Texture *target = NULL;
+        SDL_BlendMode blend = SDL_BLENDMODE_INVALID;
+        // a nested zone per run of commands recorded by the same zone, named
+        // after it. Coalesced runs count toward their first command's zone.
+        const char *stage = NULL;
+        DLE_ProfScope stage_scope = {0};
+        u32 i = 0;
+        while(i < command_count) {
+            const DLE_Command *command = &commands[i];
+            if(command->stage != stage) {
+                if(stage)
+                    prof_end(stage, stage_scope);
+                stage = command->stage;
+                if(stage)
+                    stage_scope = prof_begin(stage);
+            }
+            if(first || command->target != target) {
+                if(command->target)
+                    mask_target_begin(command->target);
+                else
+                    SDL_SetRenderTarget(r, NULL);
+                target = command->target;
+                first = false;
+            }
+            if(command->kind != COMMAND_COPY && command->blend != blend) {
+                SDL_SetRenderDrawBlendMode(r, command->blend);
+                blend = command->blend;
+            }
+            switch(command->kind) {
+                case COMMAND_FILL:
+                    i = flush_fills(i);
+                    break;
+                case COMMAND_COPY:
+                    SDL_SetTextureBlendMode(command->texture, command->blend);
+                    SDL_RenderCopyF(r, command->texture, NULL, command->whole_target ? NULL : &command->rect);
+                    i++;
+                    break;
+                case COMMAND_GEOMETRY:
+                    i = flush_geometry(i);
+                    break;
+                case COMMAND_GEOMETRY_REF:
+                    SDL_RenderGeometry(
+                        r, NULL,
+                        command->verts, I32(command->vert_count),
+                        command->indices, I32(command->index_count));
+                    i++;
+                    break;
+            }
+        }
+        if(stage)
+            prof_end(stage, stage_scope);
+        command_count = 0;
+        pass_count = 0;
+        geometry_clear(&geometry);
+        reset_render_state();
+    }
+}
+
+void commands_free(void) {
+    free_and_null(commands);
+    command_count = 0;
+    command_capacity = 0;
+    pass_count = 0;
+    geometry_free(&geometry);
+    geometry_free(&batch);
+    free_and_null(fill_rects);
+    fill_rect_capacity = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef lighting_example_commands_H
+#define lighting_example_commands_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+
+/* Deferred render command buffer.
+   Scenes record fills, copies and geometry together with their layer, render
+   target and blend mode; commands_flush groups them by layer, within a layer
+   by target and on each target by blend mode, targets and blend modes in the
+   order they were first recorded, and submits them to SDL. Recording order
+   is kept between commands with the same key, so only commands in the same
+   layer may be reordered against each other: a clear recorded first on its
+   target stays first, but anything else whose result depends on draw order
+   across blend modes goes in separate layers. Consecutive fills of one color and consecutive
+   copied geometry with the same key are coalesced into single SDL calls.
+   While profiling, the flush times its SDL work in nested zones named
+   after the zone each command was recorded in (see prof_zone).
+
+   Targets are NULL (the window) or mask targets, everything is recorded in
+   window coordinates (see mask_target_begin).
+*/
+
+typedef enum {
+    LAYER_BACKGROUND,
+    LAYER_ACTORS,
+    LAYER_MASK,
+    LAYER_COMPOSITE,
+} DLE_Layer;
+
+// The record functions return false if the buffers could not grow.
+
+// rect = NULL covers the whole target.
+bool commands_fill(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend,
+    const SDL_FRect *rect, const SDL_Color color);
+// blend is set as the texture's blend mode. dest = NULL covers the whole target.
+bool commands_copy(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend,
+    SDL_Texture *texture, const SDL_FRect *dest);
+// Untextured geometry, copied into the buffer. Indices are relative to verts.
+bool commands_geometry(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend,
+    const SDL_Vertex *verts, const u32 vert_count,
+    const int *indices, const u32 index_count);
+// Untextured geometry that is referenced, not copied: the buffers have to
+// stay valid until the flush. Never coalesced.
+bool commands_geometry_ref(
+    const DLE_Layer layer, SDL_Texture *target, const SDL_BlendMode blend,
+    const SDL_Vertex *verts, const u32 vert_count,
+    const int *indices, const u32 index_count);
+
+// submits and clears the recorded commands, then resets the render state.
+void commands_flush(void);
+void commands_free(void);
+
+#endif
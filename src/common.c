@@ -1,4 +1,8 @@
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "common.h"
 
 
@@ -19,6 +23,184 @@ void rotate_verts(SDL_FPoint origin, SDL_Vertex *verts, const u32 count, const f
         verts[i].position = rotate_point(origin, verts[i].position, degrees);
 }
 
+void frame_clock_init(DLE_FrameClock *clock, const f64 fixed_dt_ms) {
+    const u64 ticks = SDL_GetTicks64();
+    *clock = (DLE_FrameClock) {
+        .fixed_dt_ms = fixed_dt_ms,
+        .start_ticks = ticks,
+        .last_ticks = ticks,
+    };
+}
+
+void frame_clock_tick(DLE_FrameClock *clock) {
+    /* Advance to the next frame. The first tick after frame_clock_init
+       yields frame 0 at now = 0.
+    */
+    const bool first = !clock->started;
+    if(first)
+        clock->started = true;
+    else
+        clock->frame_ix++;
+
+    if(clock->fixed_dt_ms > 0) {
+        clock->dt_ms = first ? 0 : clock->fixed_dt_ms;
+        clock->now = U32(clock->frame_ix * clock->fixed_dt_ms);
+        return;
+    }
+    const u64 ticks = SDL_GetTicks64();
+    clock->dt_ms = F64(ticks - clock->last_ticks);
+    clock->now = U32(ticks - clock->start_ticks);
+    clock->last_ticks = ticks;
+}
+
+
+bool geometry_reserve(DLE_Geometry *geometry, const u32 extra_verts, const u32 extra_indices) {
+    // Returns true if successful. Grows geometrically, existing contents are kept.
+    const u32
+        verts_needed = geometry->vert_count + extra_verts,
+        indices_needed = geometry->index_count + extra_indices;
+    if(verts_needed > geometry->vert_capacity) {
+        const u32 capacity = verts_needed > geometry->vert_capacity * 2 ? verts_needed : geometry->vert_capacity * 2;
+        SDL_Vertex *verts = realloc(geometry->verts, sizeof(SDL_Vertex) * capacity);
+        if(!verts) {
+            fprintf(stderr, "%s failed to grow to %u vertices\n", __func__, capacity);
+            return false;
+        }
+        geometry->verts = verts;
+        geometry->vert_capacity = capacity;
+    }
+    if(indices_needed > geometry->index_capacity) {
+        const u32 capacity = indices_needed > geometry->index_capacity * 2 ? indices_needed : geometry->index_capacity * 2;
+        int *indices = realloc(geometry->indices, sizeof(int) * capacity);
+        if(!indices) {
+            fprintf(stderr, "%s failed to grow to %u indices\n", __func__, capacity);
+            return false;
+        }
+        geometry->indices = indices;
+        geometry->index_capacity = capacity;
+    }
+    return true;
+}
+
+void geometry_free(DLE_Geometry *geometry) {
+    free_and_null(geometry->verts);
+    free_and_null(geometry->indices);
+    *geometry = (DLE_Geometry) {0};
+}
+
+int geometry_draw(const DLE_Geometry *geometry, SDL_Texture *texture) {
+    if(!geometry->index_count)
+        return 0;
+    return SDL_RenderGeometry(
+        r, texture,
+        geometry->verts, I32(geometry->vert_count),
+        geometry->indices, I32(geometry->index_count));
+}
+
+typedef struct {
+    const char *name;
+    u64 start;
+    u64 end;
+    SDL_threadID thread_id;
+} DLE_ProfZone;
+
+bool prof_enabled = false;
+_Thread_local const char *prof_current_zone = NULL;
+static DLE_ProfZone *prof_zones = NULL;
+static SDL_atomic_t prof_zone_count;
+static char *prof_trace_path = NULL;
+static u64 prof_epoch = 0;
+
+bool prof_init(const char *trace_path) {
+    // Returns true if profiling was enabled.
+    prof_zones = malloc(sizeof(DLE_ProfZone) * PROF_MAX_ZONES);
+    prof_trace_path = malloc(strlen(trace_path) + 1);
+    if(!prof_zones || !prof_trace_path) {
+        fprintf(stderr, "%s failed to allocate zone buffer\n", __func__);
+        free_and_null(prof_zones);
+        free_and_null(prof_trace_path);
+        return false;
+    }
+    strcpy(prof_trace_path, trace_path);
+    SDL_AtomicSet(&prof_zone_count, 0);
+    prof_epoch = SDL_GetPerformanceCounter();
+    prof_enabled = true;
+    return true;
+}
+
+void prof_record(const char *name, const u64 start, const u64 end) {
+    const u32 ix = U32(SDL_AtomicAdd(&prof_zone_count, 1));
+    prof_zones[ix & (PROF_MAX_ZONES - 1)] = (DLE_ProfZone) {
+        .name = name,
+        .start = start,
+        .end = end,
+        .thread_id = SDL_ThreadID(),
+    };
+}
+
+void prof_shutdown(void) {
+    // Writes the recorded zones as Chrome trace_event JSON and disables profiling.
+    if(!prof_enabled)
+        return;
+    prof_enabled = false;
+
+    FILE *out = fopen(prof_trace_path, "w");
+    if(!out) {
+        fprintf(stderr, "%s could not open %s\n", __func__, prof_trace_path);
+    } else {
+        const u32 total = U32(SDL_AtomicGet(&prof_zone_count));
+        const u32 count = total < PROF_MAX_ZONES ? total : PROF_MAX_ZONES;
+        const f64 ticks_to_us = 1000000.0 / F64(SDL_GetPerformanceFrequency());
+        fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        for(u32 i = 0; i < count; i++) {
+            const DLE_ProfZone *zone = &prof_zones[(total - count + i) & (PROF_MAX_ZONES - 1)];
+            fprintf(out,
+                "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %lu, \"ts\": %.3f, \"dur\": %.3f}",
+                i ? ",\n" : "",
+                zone->name,
+                (unsigned long)zone->thread_id,
+                F64(zone->start - prof_epoch) * ticks_to_us,
+                F64(zone->end - zone->start) * ticks_to_us);
+        }
+        fprintf(out, "\n]}\n");
+        fclose(out);
+        printf("wrote %u trace zones to %s\n", count, prof_trace_path);
+    }
+    free_and_null(prof_zones);
+    free_and_null(prof_trace_path);
+}
+
 
 SDL_Window *w = NULL;
 SDL_Renderer *r = NULL;
+u32 mask_scale = 1;
+
+SDL_Texture *mask_texture_create(const int access) {
+    SDL_Texture *mask = SDL_CreateTexture(
+        r,
+        SDL_PIXELFORMAT_RGBA8888,
+        access,
+        I32(mask_width()), I32(mask_height()));
+    if(!mask) {
+        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
+        return NULL;
+    }
+    SDL_SetTextureBlendMode(mask, SDL_BLENDMODE_BLEND);
+    if(mask_scale > 1)
+        SDL_SetTextureScaleMode(mask, SDL_ScaleModeLinear);
+    return mask;
+}
+
+void mask_target_begin(SDL_Texture *mask) {
+    // SDL resets the render scale whenever the target changes.
+    SDL_SetRenderTarget(r, mask);
+    if(mask_scale > 1)
+        SDL_RenderSetScale(r, 1.0f / mask_scale, 1.0f / mask_scale);
+}
+
+bool render_blend_supported(const SDL_BlendMode blend) {
+    // SDL refuses draw blend modes the renderer can't do.
+    const bool supported = SDL_SetRenderDrawBlendMode(r, blend) == 0;
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
+    return supported;
+}
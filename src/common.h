@@ -2,6 +2,7 @@
 #ifndef lighting_example_common_H
 #define lighting_example_common_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "SDL2/SDL.h"
@@ -40,6 +41,47 @@ typedef double      f64;
 extern SDL_Window *w;
 extern SDL_Renderer *r;
 
+/* Frame clock passed from the main loop into every scene's draw function.
+   With fixed_dt_ms > 0 the clock ignores wall time and advances by exactly
+   fixed_dt_ms per frame (replay mode), so runs render identical frames.
+*/
+typedef struct {
+    u32 now;          // milliseconds since the clock started
+    u32 frame_ix;     // frames since the clock started
+    f64 dt_ms;        // milliseconds since the previous frame
+    f64 fixed_dt_ms;  // 0 = wall clock
+    u64 start_ticks;
+    u64 last_ticks;
+    bool started;
+} DLE_FrameClock;
+
+void frame_clock_init(DLE_FrameClock *clock, const f64 fixed_dt_ms);
+void frame_clock_tick(DLE_FrameClock *clock);
+
+/* Light masks are low frequency, so mask render targets are allocated at
+   1/mask_scale of the window (MASK_SCALE=1|2|4|8) and composited with linear
+   filtering. Scenes keep drawing in window coordinates, mask_target_begin
+   sets a render scale that maps them into mask space.
+*/
+#define MASK_SCALE_MAX 8
+extern u32 mask_scale;
+
+static inline u32 mask_width(void) {
+    return (WINDOW_WIDTH + mask_scale - 1) / mask_scale;
+}
+
+static inline u32 mask_height(void) {
+    return (WINDOW_HEIGHT + mask_scale - 1) / mask_scale;
+}
+
+// returns NULL on failure. The texture uses SDL_BLENDMODE_BLEND.
+SDL_Texture *mask_texture_create(const int access);
+// makes mask the render target with window coordinates mapped onto it.
+void mask_target_begin(SDL_Texture *mask);
+// whether the renderer can draw with blend, custom blend modes are
+// renderer specific (the software renderer has none).
+bool render_blend_supported(const SDL_BlendMode blend);
+
 #define free_and_null(ptr) if(ptr) { free(ptr); ptr = NULL; }
 #define free_texture_and_null(ptr) if(ptr) { SDL_DestroyTexture(ptr); ptr = NULL; }
 
@@ -61,6 +103,96 @@ void rotate_verts(
     const f32 degrees
 );
 
+/* Growable vertex/index buffer for batching SDL_RenderGeometry submissions.
+*/
+typedef struct {
+    SDL_Vertex *verts;
+    int *indices;
+    u32 vert_count;
+    u32 vert_capacity;
+    u32 index_count;
+    u32 index_capacity;
+} DLE_Geometry;
+
+// returns false if the buffers could not grow to fit the extra vertices/indices.
+bool geometry_reserve(DLE_Geometry *geometry, const u32 extra_verts, const u32 extra_indices);
+void geometry_free(DLE_Geometry *geometry);
+int geometry_draw(const DLE_Geometry *geometry, SDL_Texture *texture);
+
+static inline void geometry_clear(DLE_Geometry *geometry) {
+    geometry->vert_count = 0;
+    geometry->index_count = 0;
+}
+
+// caller reserved room for 4 vertices and 6 indices. Corners are clockwise from top left.
+static inline void geometry_push_quad(
+    DLE_Geometry *geometry,
+    const SDL_FPoint p0, const SDL_FPoint p1, const SDL_FPoint p2, const SDL_FPoint p3,
+    const SDL_Color c0, const SDL_Color c1, const SDL_Color c2, const SDL_Color c3
+) {
+    const int base = I32(geometry->vert_count);
+    SDL_Vertex *v = &geometry->verts[geometry->vert_count];
+    v[0] = (SDL_Vertex) {p0, c0, (SDL_FPoint){0}};
+    v[1] = (SDL_Vertex) {p1, c1, (SDL_FPoint){0}};
+    v[2] = (SDL_Vertex) {p2, c2, (SDL_FPoint){0}};
+    v[3] = (SDL_Vertex) {p3, c3, (SDL_FPoint){0}};
+    geometry->vert_count += 4;
+    int *ix = &geometry->indices[geometry->index_count];
+    ix[0] = base; ix[1] = base + 1; ix[2] = base + 2;
+    ix[3] = base; ix[4] = base + 2; ix[5] = base + 3;
+    geometry->index_count += 6;
+}
+
+/* Scoped zone timers.
+   Zones are recorded into a preallocated ring buffer (the oldest zones are
+   overwritten once it is full) and written out as a Chrome trace_event JSON
+   file by prof_shutdown. When profiling is disabled a zone costs one branch.
+
+       prof_zone("mask_composite") {
+           SDL_RenderCopyF(r, light_mask, NULL, NULL);
+       }
+
+   While profiling, prof_current_zone is the innermost open zone of the
+   calling thread (NULL outside of every zone), so deferred work can be
+   attributed to the zone that recorded it.
+   Leaving a zone with return/break/goto drops the zone and leaves it
+   current until the enclosing zone ends.
+*/
+#define PROF_MAX_ZONES (1 << 16)
+
+extern bool prof_enabled;
+extern _Thread_local const char *prof_current_zone;
+
+bool prof_init(const char *trace_path);
+void prof_shutdown(void);
+void prof_record(const char *name, const u64 start, const u64 end);
+
+typedef struct {
+    u64 start;          // 0 when profiling is disabled
+    const char *outer;  // prof_current_zone to restore
+    bool open;
+} DLE_ProfScope;
+
+static inline DLE_ProfScope prof_begin(const char *name) {
+    if(!prof_enabled)
+        return (DLE_ProfScope){ .open = true };
+    const DLE_ProfScope scope = { SDL_GetPerformanceCounter(), prof_current_zone, true };
+    prof_current_zone = name;
+    return scope;
+}
+
+static inline void prof_end(const char *name, const DLE_ProfScope scope) {
+    if(!scope.start)
+        return;
+    prof_record(name, scope.start, SDL_GetPerformanceCounter());
+    prof_current_zone = scope.outer;
+}
+
+#define prof_zone(name) \
+    for(DLE_ProfScope prof_zone_scope_ = prof_begin(name); \
+        prof_zone_scope_.open; \
+        prof_zone_scope_.open = false, prof_end((name), prof_zone_scope_))
+
 #define reset_render_state() do { \
     SDL_SetRenderTarget(r, NULL); \
     SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND); \
@@ -0,0 +1,554 @@
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "lightfield.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DLE_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+
+typedef void (*DLE_LightRowKernel)(
+    const DLE_LightSoA *lights,
+    const f32 x0,
+    const f32 dx,
+    const f32 y,
+    const u32 count,
+    const u8 ambient_alpha,
+    u8 *out
+);
+
+bool light_soa_reserve(DLE_LightSoA *soa, const u32 capacity) {
+    // Returns true if successful. Existing lights are not preserved.
+    if(capacity <= soa->capacity)
+        return true;
+    light_soa_free(soa);
+    soa->x = malloc(sizeof(f32) * capacity);
+    soa->y = malloc(sizeof(f32) * capacity);
+    soa->radius_squared = malloc(sizeof(f32) * capacity);
+    soa->inv_radius_squared = malloc(sizeof(f32) * capacity);
+    soa->min_alpha = malloc(sizeof(u8) * capacity);
+    if(!soa->x || !soa->y || !soa->radius_squared || !soa->inv_radius_squared || !soa->min_alpha) {
+        fprintf(stderr, "%s failed to allocate %u lights\n", __func__, capacity);
+        light_soa_free(soa);
+        return false;
+    }
+    soa->capacity = capacity;
+    return true;
+}
+
+void light_soa_free(DLE_LightSoA *soa) {
+    free_and_null(soa->x);
+    free_and_null(soa->y);
+    free_and_null(soa->radius_squared);
+    free_and_null(soa->inv_radius_squared);
+    free_and_null(soa->min_alpha);
+    soa->count = 0;
+    soa->capacity = 0;
+}
+
+void light_soa_load(DLE_LightSoA *soa, const DLE_LightSource *lights, const u32 count) {
+    for(u32 i = 0; i < count; i++) {
+        soa->x[i] = lights[i].position.x;
+        soa->y[i] = lights[i].position.y;
+        soa->radius_squared[i] = lights[i].radius_squared;
+        soa->inv_radius_squared[i] = 1.0f / lights[i].radius_squared;
+        soa->min_alpha[i] = lights[i].min_alpha;
+    }
+    soa->count = count;
+}
+
+
+/* reference kernel: the original per-sample loop (double-precision combine),
+   kept to validate the others.
+*/
+
+static inline u8 get_ambient_light_at_position(
+    const f32 x,
+    const f32 y,
+    const u8 ambient_alpha,
+    const DLE_LightSoA *lights
+) {
+    if(lights->count == 0)
+        return ambient_alpha;
+
+    // multiplicative combine of every overlapping light, no cap on the overlap count.
+    double combined_darkness = 1.0;
+    f32 min_a = 0;
+    u32 count = 0;
+    for(u32 i = 0; i < lights->count; i++) {
+        const f32 ds = dist_sq(x, y, lights->x[i], lights->y[i]);
+        if(ds > lights->radius_squared[i])
+            continue;
+
+        // 0 = brightest, 1 = ambient darkness
+        const f32 ndist = (ds) / (lights->radius_squared[i]);
+        const f32 perc_from_edge =  easingSmoothEnd2(ndist);
+        const f32 alpha_range = (ambient_alpha - lights->min_alpha[i]);
+        const u8 ls_a = lights->min_alpha[i] + U8(alpha_range * perc_from_edge);
+
+        combined_darkness *= ls_a / 255.0;
+
+        if(!(count++))
+            min_a = ls_a;
+        else
+            min_a = ls_a < min_a ? ls_a : min_a;
+    }
+    if(!count) return ambient_alpha;
+    if(count == 1) return min_a;
+    return U8(combined_darkness * 255.0);
+}
+
+static void eval_row_reference(
+    const DLE_LightSoA *lights, const f32 x0, const f32 dx, const f32 y,
+    const u32 count, const u8 ambient_alpha, u8 *out
+) {
+    for(u32 i = 0; i < count; i++)
+        out[i] = get_ambient_light_at_position(x0 + i * dx, y, ambient_alpha, lights);
+}
+
+
+/* scalar kernel: same math as the SIMD lanes. Single precision, reciprocal
+   radii and a running product instead of a sample buffer.
+*/
+
+static inline u8 sample_scalar(
+    const DLE_LightSoA *lights, const f32 x, const f32 y, const u8 ambient_alpha
+) {
+    f32 darkness = 1.0f;
+    u32 hits = 0;
+    u8 single_a = ambient_alpha;
+    for(u32 i = 0; i < lights->count; i++) {
+        const f32 ds = dist_sq(x, y, lights->x[i], lights->y[i]);
+        if(ds > lights->radius_squared[i])
+            continue;
+        const f32 ndist = ds * lights->inv_radius_squared[i];
+        const f32 alpha_range = F32(ambient_alpha - lights->min_alpha[i]);
+        const u8 ls_a = lights->min_alpha[i] + U8(alpha_range * easingSmoothEnd2(ndist));
+        darkness *= ls_a * (1.0f / 255.0f);
+        single_a = ls_a;
+        hits++;
+    }
+    if(!hits) return ambient_alpha;
+    if(hits == 1) return single_a;
+    return U8(darkness * 255.0f);
+}
+
+static void eval_row_scalar(
+    const DLE_LightSoA *lights, const f32 x0, const f32 dx, const f32 y,
+    const u32 count, const u8 ambient_alpha, u8 *out
+) {
+    for(u32 i = 0; i < count; i++)
+        out[i] = sample_scalar(lights, x0 + i * dx, y, ambient_alpha);
+}
+
+
+/* fixed kernel: integer pipeline. Overlapping lights are combined with a
+   Q15 fixed-point product of table alphas instead of the reference's double
+   product. Each light's alpha is the reference's own truncation of the
+   single precision falloff: a falloff table indexed by quantized normalized
+   distance lands a step off wherever that truncation is close to a whole
+   step, and overlapping lights add those steps up. Samples are processed in
+   blocks with lights in the outer loop so the inner loop is branch free.
+*/
+
+#define FIXED_ONE (1u << 15)
+#define FIXED_BLOCK 64
+static u32 alpha_q15[256];  // a / 255 in Q15
+static bool fixed_tables_ready = false;
+
+static void build_fixed_tables(void) {
+    for(u32 a = 0; a < 256; a++)
+        alpha_q15[a] = (a * FIXED_ONE + 127) / 255;
+    fixed_tables_ready = true;
+}
+
+static void eval_row_fixed(
+    const DLE_LightSoA *lights, const f32 x0, const f32 dx, const f32 y,
+    const u32 count, const u8 ambient_alpha, u8 *out
+) {
+    u32 darkness[FIXED_BLOCK];
+    u32 single_a[FIXED_BLOCK];
+    u32 hits[FIXED_BLOCK];
+    for(u32 block = 0; block < count; block += FIXED_BLOCK) {
+        const u32 n = count - block < FIXED_BLOCK ? count - block : FIXED_BLOCK;
+        const f32 bx0 = x0 + block * dx;
+        for(u32 j = 0; j < n; j++) {
+            darkness[j] = FIXED_ONE;
+            single_a[j] = ambient_alpha;
+            hits[j] = 0;
+        }
+        for(u32 l = 0; l < lights->count; l++) {
+            const f32 ddy = lights->y[l] - y;
+            const f32 dy2 = ddy * ddy;
+            const f32 r2 = lights->radius_squared[l];
+            if(dy2 > r2)
+                continue;
+            const f32
+                lx = lights->x[l],
+                inv_r2 = lights->inv_radius_squared[l];
+            const u32 min_a = lights->min_alpha[l];
+            const f32 range = F32(ambient_alpha - min_a);
+            for(u32 j = 0; j < n; j++) {
+                const f32 ddx = lx - (bx0 + j * dx);
+                const f32 ds = ddx * ddx + dy2;
+                const u32 inside = ds <= r2;
+                // outside lights are masked below; keep their falloff in range
+                const f32 ndist = inside ? ds * inv_r2 : 0;
+                const u32 ls_a = min_a + U32(range * easingSmoothEnd2(ndist));
+                const u32 factor = inside ? alpha_q15[ls_a] : FIXED_ONE;
+                darkness[j] = (darkness[j] * factor + (FIXED_ONE >> 1)) >> 15;
+                single_a[j] = inside ? ls_a : single_a[j];
+                hits[j] += inside;
+            }
+        }
+        for(u32 j = 0; j < n; j++)
+            out[block + j] = hits[j] > 1 ? U8((darkness[j] * 255) >> 15) : U8(single_a[j]);
+    }
+}
+
+
+#ifdef DLE_HAVE_X86_SIMD
+
+/* SSE2 kernel: 4 samples per iteration.
+*/
+__attribute__((target("sse2")))
+static void eval_row_sse2(
+    const DLE_LightSoA *lights, const f32 x0, const f32 dx, const f32 y,
+    const u32 count, const u8 ambient_alpha, u8 *out
+) {
+    const __m128
+        one = _mm_set1_ps(1.0f),
+        inv_255 = _mm_set1_ps(1.0f / 255.0f),
+        v_255 = _mm_set1_ps(255.0f),
+        ambient = _mm_set1_ps(ambient_alpha),
+        lane_dx = _mm_mul_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(dx)),
+        sy = _mm_set1_ps(y);
+    u32 i = 0;
+    for(; i + 4 <= count; i += 4) {
+        const __m128 sx = _mm_add_ps(_mm_set1_ps(x0 + i * dx), lane_dx);
+        __m128
+            darkness = one,
+            hits = _mm_setzero_ps(),
+            single_a = ambient;
+        for(u32 l = 0; l < lights->count; l++) {
+            const __m128
+                ddx = _mm_sub_ps(_mm_set1_ps(lights->x[l]), sx),
+                ddy = _mm_sub_ps(_mm_set1_ps(lights->y[l]), sy),
+                ds = _mm_add_ps(_mm_mul_ps(ddx, ddx), _mm_mul_ps(ddy, ddy)),
+                inside = _mm_cmple_ps(ds, _mm_set1_ps(lights->radius_squared[l]));
+            if(!_mm_movemask_ps(inside))
+                continue;
+            const __m128
+                ndist = _mm_mul_ps(ds, _mm_set1_ps(lights->inv_radius_squared[l])),
+                t = _mm_sub_ps(one, ndist),
+                perc_from_edge = _mm_sub_ps(one, _mm_mul_ps(t, t)),
+                min_a = _mm_set1_ps(lights->min_alpha[l]),
+                range = _mm_sub_ps(ambient, min_a),
+                ls_a = _mm_add_ps(min_a, _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(range, perc_from_edge)))),
+                factor = _mm_or_ps(_mm_and_ps(inside, _mm_mul_ps(ls_a, inv_255)), _mm_andnot_ps(inside, one));
+            darkness = _mm_mul_ps(darkness, factor);
+            single_a = _mm_or_ps(_mm_and_ps(inside, ls_a), _mm_andnot_ps(inside, single_a));
+            hits = _mm_add_ps(hits, _mm_and_ps(inside, one));
+        }
+        const __m128
+            combined = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(darkness, v_255))),
+            is_multi = _mm_cmpgt_ps(hits, one),
+            result = _mm_or_ps(_mm_and_ps(is_multi, combined), _mm_andnot_ps(is_multi, single_a));
+        const __m128i
+            r32 = _mm_cvttps_epi32(result),
+            r16 = _mm_packs_epi32(r32, r32),
+            r8 = _mm_packus_epi16(r16, r16);
+        const i32 packed = _mm_cvtsi128_si32(r8);
+        memcpy(out + i, &packed, 4);
+    }
+    for(; i < count; i++)
+        out[i] = sample_scalar(lights, x0 + i * dx, y, ambient_alpha);
+}
+
+/* AVX2 kernel: 8 samples per iteration.
+*/
+__attribute__((target("avx2")))
+static void eval_row_avx2(
+    const DLE_LightSoA *lights, const f32 x0, const f32 dx, const f32 y,
+    const u32 count, const u8 ambient_alpha, u8 *out
+) {
+    const __m256
+        one = _mm256_set1_ps(1.0f),
+        inv_255 = _mm256_set1_ps(1.0f / 255.0f),
+        v_255 = _mm256_set1_ps(255.0f),
+        ambient = _mm256_set1_ps(ambient_alpha),
+        lane_dx = _mm256_mul_ps(_mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0), _mm256_set1_ps(dx)),
+        sy = _mm256_set1_ps(y);
+    u32 i = 0;
+    for(; i + 8 <= count; i += 8) {
+        const __m256 sx = _mm256_add_ps(_mm256_set1_ps(x0 + i * dx), lane_dx);
+        __m256
+            darkness = one,
+            hits = _mm256_setzero_ps(),
+            single_a = ambient;
+        for(u32 l = 0; l < lights->count; l++) {
+            const __m256
+                ddx = _mm256_sub_ps(_mm256_set1_ps(lights->x[l]), sx),
+                ddy = _mm256_sub_ps(_mm256_set1_ps(lights->y[l]), sy),
+                ds = _mm256_add_ps(_mm256_mul_ps(ddx, ddx), _mm256_mul_ps(ddy, ddy)),
+                inside = _mm256_cmp_ps(ds, _mm256_set1_ps(lights->radius_squared[l]), _CMP_LE_OQ);
+            if(!_mm256_movemask_ps(inside))
+                continue;
+            const __m256
+                ndist = _mm256_mul_ps(ds, _mm256_set1_ps(lights->inv_radius_squared[l])),
+                t = _mm256_sub_ps(one, ndist),
+                perc_from_edge = _mm256_sub_ps(one, _mm256_mul_ps(t, t)),
+                min_a = _mm256_set1_ps(lights->min_alpha[l]),
+                range = _mm256_sub_ps(ambient, min_a),
+                ls_a = _mm256_add_ps(min_a, _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_mul_ps(range, perc_from_edge))));
+            darkness = _mm256_mul_ps(darkness, _mm256_blendv_ps(one, _mm256_mul_ps(ls_a, inv_255), inside));
+            single_a = _mm256_blendv_ps(single_a, ls_a, inside);
+            hits = _mm256_add_ps(hits, _mm256_and_ps(inside, one));
+        }
+        const __m256
+            combined = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_mul_ps(darkness, v_255))),
+            result = _mm256_blendv_ps(single_a, combined, _mm256_cmp_ps(hits, one, _CMP_GT_OQ));
+        const __m256i r32 = _mm256_cvttps_epi32(result);
+        const __m128i
+            r16 = _mm_packs_epi32(_mm256_castsi256_si128(r32), _mm256_extracti128_si256(r32, 1)),
+            r8 = _mm_packus_epi16(r16, r16);
+        _mm_storel_epi64((__m128i*)(out + i), r8);
+    }
+    for(; i < count; i++)
+        out[i] = sample_scalar(lights, x0 + i * dx, y, ambient_alpha);
+}
+
+#endif
+
+
+typedef struct {
+    const char *name;
+    DLE_LightRowKernel fn;
+} DLE_LightKernelEntry;
+
+static const DLE_LightKernelEntry kernels[] = {
+    {"reference", eval_row_reference},
+    {"scalar", eval_row_scalar},
+    {"fixed", eval_row_fixed},
+#ifdef DLE_HAVE_X86_SIMD
+    {"sse2", eval_row_sse2},
+    {"avx2", eval_row_avx2},
+#endif
+};
+
+static const DLE_LightKernelEntry *selected_kernel = NULL;
+
+bool light_field_kernel_supported(const char *name) {
+    if(strcmp(name, "sse2") == 0)
+        return SDL_HasSSE2();
+    if(strcmp(name, "avx2") == 0)
+        return SDL_HasAVX2();
+    return true;
+}
+
+bool light_field_select_kernel(const char *name) {
+    // Returns true if the kernel was selected.
+    const u32 kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+    if(!fixed_tables_ready)
+        build_fixed_tables();
+    if(!name) {
+        // best supported kernel, kernels are listed from slowest to fastest.
+        for(u32 i = kernel_count; i > 0; i--) {
+            if(light_field_kernel_supported(kernels[i - 1].name)) {
+                selected_kernel = &kernels[i - 1];
+                return true;
+            }
+        }
+        return false;
+    }
+    for(u32 i = 0; i < kernel_count; i++) {
+        if(strcmp(kernels[i].name, name) != 0)
+            continue;
+        if(!light_field_kernel_supported(name)) {
+            fprintf(stderr, "%s light kernel %s is not supported by this CPU\n", __func__, name);
+            return false;
+        }
+        selected_kernel = &kernels[i];
+        return true;
+    }
+    fprintf(stderr, "%s unknown light kernel %s\n", __func__, name);
+    return false;
+}
+
+const char *light_field_kernel_name(void) {
+    if(!selected_kernel)
+        light_field_select_kernel(NULL);
+    return selected_kernel->name;
+}
+
+void light_field_eval_row(
+    const DLE_LightSoA *lights,
+    const f32 x0,
+    const f32 dx,
+    const f32 y,
+    const u32 count,
+    const u8 ambient_alpha,
+    u8 *out
+) {
+    if(!selected_kernel)
+        light_field_select_kernel(NULL);
+    if(lights->count == 0) {
+        memset(out, ambient_alpha, count);
+        return;
+    }
+    selected_kernel->fn(lights, x0, dx, y, count, ambient_alpha, out);
+}
+
+
+bool light_bins_init(DLE_LightBins *bins, const u32 width, const u32 height, const u32 tile_size) {
+    // Returns true if successful.
+    *bins = (DLE_LightBins) {0};
+    bins->tile_size = tile_size;
+    bins->cols = (width + tile_size - 1) / tile_size;
+    bins->rows = (height + tile_size - 1) / tile_size;
+    const u32 tile_count = bins->cols * bins->rows;
+    bins->tile_offsets = calloc(tile_count + 1, sizeof(u32));
+    bins->tile_cursor = calloc(tile_count, sizeof(u32));
+    if(!bins->tile_offsets || !bins->tile_cursor) {
+        fprintf(stderr, "%s failed to allocate %u tiles\n", __func__, tile_count);
+        light_bins_free(bins);
+        return false;
+    }
+    return true;
+}
+
+void light_bins_free(DLE_LightBins *bins) {
+    free_and_null(bins->tile_offsets);
+    free_and_null(bins->tile_cursor);
+    light_soa_free(&bins->lights);
+}
+
+static inline u32 clamp_tile(const f32 v, const u32 tile_size, const u32 tiles) {
+    if(v <= 0)
+        return 0;
+    const u32 tile = U32(v) / tile_size;
+    return tile < tiles ? tile : tiles - 1;
+}
+
+static inline bool light_touches_tile(
+    const DLE_LightBins *bins, const DLE_LightSoA *lights, const u32 light, const u32 col, const u32 row
+) {
+    // closest point of the tile to the light. Edge tiles extend to infinity
+    // because samples beyond the grid are clamped into them.
+    const f32
+        tile_x1 = col == 0 ? -INFINITY : F32(col * bins->tile_size),
+        tile_y1 = row == 0 ? -INFINITY : F32(row * bins->tile_size),
+        tile_x2 = col == bins->cols - 1 ? INFINITY : F32((col + 1) * bins->tile_size),
+        tile_y2 = row == bins->rows - 1 ? INFINITY : F32((row + 1) * bins->tile_size);
+    const f32
+        lx = lights->x[light],
+        ly = lights->y[light],
+        cx = lx < tile_x1 ? tile_x1 : (lx > tile_x2 ? tile_x2 : lx),
+        cy = ly < tile_y1 ? tile_y1 : (ly > tile_y2 ? tile_y2 : ly);
+    return dist_sq(lx, ly, cx, cy) <= lights->radius_squared[light];
+}
+
+#define for_each_light_tile(bins, lights, light, col, row) \
+    for(u32 row = clamp_tile(lights->y[light] - sqrtf(lights->radius_squared[light]), bins->tile_size, bins->rows), \
+            row##_end = clamp_tile(lights->y[light] + sqrtf(lights->radius_squared[light]), bins->tile_size, bins->rows); \
+        row <= row##_end; row++) \
+    for(u32 col = clamp_tile(lights->x[light] - sqrtf(lights->radius_squared[light]), bins->tile_size, bins->cols), \
+            col##_end = clamp_tile(lights->x[light] + sqrtf(lights->radius_squared[light]), bins->tile_size, bins->cols); \
+        col <= col##_end; col++) \
+    if(light_touches_tile(bins, lights, light, col, row))
+
+bool light_bins_build(DLE_LightBins *bins, const DLE_LightSoA *lights) {
+    // Returns true if successful.
+    const u32 tile_count = bins->cols * bins->rows;
+    memset(bins->tile_cursor, 0, sizeof(u32) * tile_count);
+
+    // count
+    for(u32 i = 0; i < lights->count; i++) {
+        for_each_light_tile(bins, lights, i, col, row)
+            bins->tile_cursor[row * bins->cols + col]++;
+    }
+
+    // storage first, offsets are only published once they point into it
+    u32 total = 0;
+    for(u32 t = 0; t < tile_count; t++)
+        total += bins->tile_cursor[t];
+    if(total > bins->lights.capacity) {
+        // grow with headroom so a slowly growing light set doesn't realloc every frame.
+        if(!light_soa_reserve(&bins->lights, total + total / 2)) {
+            // the reserve freed the old storage, leave every tile empty
+            memset(bins->tile_offsets, 0, sizeof(u32) * (tile_count + 1));
+            return false;
+        }
+    }
+
+    // prefix sum
+    total = 0;
+    for(u32 t = 0; t < tile_count; t++) {
+        bins->tile_offsets[t] = total;
+        total += bins->tile_cursor[t];
+        bins->tile_cursor[t] = bins->tile_offsets[t];
+    }
+    bins->tile_offsets[tile_count] = total;
+
+    // scatter
+    DLE_LightSoA *binned = &bins->lights;
+    for(u32 i = 0; i < lights->count; i++) {
+        for_each_light_tile(bins, lights, i, col, row) {
+            const u32 slot = bins->tile_cursor[row * bins->cols + col]++;
+            binned->x[slot] = lights->x[i];
+            binned->y[slot] = lights->y[i];
+            binned->radius_squared[slot] = lights->radius_squared[i];
+            binned->inv_radius_squared[slot] = lights->inv_radius_squared[i];
+            binned->min_alpha[slot] = lights->min_alpha[i];
+        }
+    }
+    binned->count = total;
+    return true;
+}
+
+static inline DLE_LightSoA tile_view(const DLE_LightBins *bins, const u32 tile) {
+    const u32 first = bins->tile_offsets[tile], last = bins->tile_offsets[tile + 1];
+    return (DLE_LightSoA) {
+        .x = bins->lights.x + first,
+        .y = bins->lights.y + first,
+        .radius_squared = bins->lights.radius_squared + first,
+        .inv_radius_squared = bins->lights.inv_radius_squared + first,
+        .min_alpha = bins->lights.min_alpha + first,
+        .count = last - first,
+        .capacity = last - first,
+    };
+}
+
+DLE_LightSoA light_bins_tile(const DLE_LightBins *bins, const f32 x, const f32 y) {
+    const u32
+        col = clamp_tile(x, bins->tile_size, bins->cols),
+        row = clamp_tile(y, bins->tile_size, bins->rows);
+    return tile_view(bins, row * bins->cols + col);
+}
+
+void light_bins_eval_row(
+    const DLE_LightBins *bins,
+    const f32 x0,
+    const f32 dx,
+    const f32 y,
+    const u32 count,
+    const u8 ambient_alpha,
+    u8 *out
+) {
+    const u32 tile_row = clamp_tile(y, bins->tile_size, bins->rows);
+    u32 i = 0;
+    while(i < count) {
+        // run of samples that fall into the same tile
+        const u32 tile_col = clamp_tile(x0 + i * dx, bins->tile_size, bins->cols);
+        u32 run_end = i + 1;
+        while(run_end < count && clamp_tile(x0 + run_end * dx, bins->tile_size, bins->cols) == tile_col)
+            run_end++;
+
+        const DLE_LightSoA tile_lights = tile_view(bins, tile_row * bins->cols + tile_col);
+        light_field_eval_row(&tile_lights, x0 + i * dx, dx, y, run_end - i, ambient_alpha, out + i);
+        i = run_end;
+    }
+}
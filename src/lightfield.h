@@ -0,0 +1,92 @@
+
+#ifndef lighting_example_lightfield_H
+#define lighting_example_lightfield_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+
+typedef struct {
+    SDL_FPoint position;
+    f32 radius_squared;
+    u8 min_alpha; // (max liminocity)
+} DLE_LightSource;
+
+/* Structure-of-arrays copy of a set of light sources, laid out for the
+   vectorized light field kernels.
+*/
+typedef struct {
+    f32 *x;
+    f32 *y;
+    f32 *radius_squared;
+    f32 *inv_radius_squared;
+    u8 *min_alpha;
+    u32 count;
+    u32 capacity;
+} DLE_LightSoA;
+
+bool light_soa_reserve(DLE_LightSoA *soa, const u32 capacity);
+void light_soa_free(DLE_LightSoA *soa);
+// caller guarantees soa has capacity for count lights.
+void light_soa_load(DLE_LightSoA *soa, const DLE_LightSource *lights, const u32 count);
+
+/* Evaluate the light field at `count` samples (x0 + i*dx, y) into out.
+   caller guarantees that ambient_alpha >= all light sources' min_alpha
+*/
+void light_field_eval_row(
+    const DLE_LightSoA *lights,
+    const f32 x0,
+    const f32 dx,
+    const f32 y,
+    const u32 count,
+    const u8 ambient_alpha,
+    u8 *out
+);
+
+/* Screen-space light bins.
+   light_bins_build assigns every light to each tile its radius touches and
+   stores the tiles' lights contiguously (as a DLE_LightSoA), so a sample only
+   iterates the lights of its own tile. There is no cap on the number of
+   lights per tile; storage grows as needed.
+*/
+typedef struct {
+    u32 tile_size;
+    u32 cols;
+    u32 rows;
+    u32 *tile_offsets;  // cols * rows + 1 offsets into lights
+    u32 *tile_cursor;   // scratch for build
+    DLE_LightSoA lights;
+} DLE_LightBins;
+
+bool light_bins_init(DLE_LightBins *bins, const u32 width, const u32 height, const u32 tile_size);
+void light_bins_free(DLE_LightBins *bins);
+// returns false if the binned light storage could not grow, every tile is
+// empty then.
+bool light_bins_build(DLE_LightBins *bins, const DLE_LightSoA *lights);
+
+// the lights binned into the tile that contains (x, y).
+DLE_LightSoA light_bins_tile(const DLE_LightBins *bins, const f32 x, const f32 y);
+
+// light_field_eval_row over binned lights, splitting the row at tile borders.
+void light_bins_eval_row(
+    const DLE_LightBins *bins,
+    const f32 x0,
+    const f32 dx,
+    const f32 y,
+    const u32 count,
+    const u8 ambient_alpha,
+    u8 *out
+);
+
+/* Kernel selection: "reference" (the original double-precision sample loop),
+   "scalar", "fixed" (fixed-point combine), "sse2", "avx2" or
+   NULL for the best kernel this CPU supports.
+   Returns false if the kernel is unknown or unsupported.
+*/
+bool light_field_select_kernel(const char *name);
+// true for every kernel that is not an instruction set this CPU lacks.
+bool light_field_kernel_supported(const char *name);
+const char *light_field_kernel_name(void);
+
+#endif
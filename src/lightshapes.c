@@ -0,0 +1,180 @@
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lightshapes.h"
+
+
+static DLE_LightShape *shapes[LIGHT_SHAPES_MAX];
+static u32 shape_count = 0;
+
+static void build_shape(DLE_LightShape *shape) {
+    // fills points/indices of a unit shape as a triangle fan around point 0.
+    const u32 segments = shape->segments;
+    SDL_FPoint *p = shape->points;
+    int *ix = shape->indices;
+    u32 n = 0, k = 0;
+    p[n++] = (SDL_FPoint) {0, 0};
+    switch(shape->kind) {
+        case LIGHT_SHAPE_CONE:
+            p[n++] = (SDL_FPoint) {-shape->param, 0}; // near left
+            for(u32 i = 0; i <= segments; i++)        // far edge, left to right
+                p[n++] = (SDL_FPoint) {-1 + 2 * F32(i) / segments, -1};
+            p[n++] = (SDL_FPoint) {shape->param, 0};  // near right
+            for(u32 i = 1; i + 1 < n; i++) {
+                ix[k++] = 0; ix[k++] = I32(i); ix[k++] = I32(i + 1);
+            }
+            break;
+        case LIGHT_SHAPE_FAN: {
+            const f64 spread = shape->param * PI_OVER_180;
+            for(u32 i = 0; i <= segments; i++) {
+                const f64 a = -spread * 0.5 + spread * i / segments;
+                p[n++] = (SDL_FPoint) {F32(sin(a)), F32(-cos(a))};
+            }
+            for(u32 i = 1; i + 1 < n; i++) {
+                ix[k++] = 0; ix[k++] = I32(i); ix[k++] = I32(i + 1);
+            }
+        } break;
+        case LIGHT_SHAPE_CIRCLE:
+            for(u32 i = 0; i < segments; i++) {
+                const f64 a = 360 * PI_OVER_180 * i / segments;
+                p[n++] = (SDL_FPoint) {F32(sin(a)), F32(-cos(a))};
+            }
+            for(u32 i = 1; i < n; i++) {
+                ix[k++] = 0; ix[k++] = I32(i); ix[k++] = I32(i + 1 < n ? i + 1 : 1);
+            }
+            break;
+        case LIGHT_SHAPE_RINGS: {
+            const u32 rings = U32(shape->param);
+            for(u32 ring = 1; ring <= rings; ring++) {
+                const f64 radius = F64(ring) / rings;
+                for(u32 i = 0; i < segments; i++) {
+                    const f64 a = 360 * PI_OVER_180 * i / segments;
+                    p[n++] = (SDL_FPoint) {F32(sin(a) * radius), F32(-cos(a) * radius)};
+                }
+            }
+            // center fan, then a band of quads between each pair of rings
+            for(u32 i = 0; i < segments; i++) {
+                ix[k++] = 0; ix[k++] = I32(1 + i); ix[k++] = I32(1 + (i + 1) % segments);
+            }
+            for(u32 ring = 1; ring < rings; ring++) {
+                const u32 inner = 1 + (ring - 1) * segments, outer = inner + segments;
+                for(u32 i = 0; i < segments; i++) {
+                    const u32 j = (i + 1) % segments;
+                    ix[k++] = I32(inner + i); ix[k++] = I32(outer + i); ix[k++] = I32(outer + j);
+                    ix[k++] = I32(inner + i); ix[k++] = I32(outer + j); ix[k++] = I32(inner + j);
+                }
+            }
+        } break;
+    }
+    shape->point_count = n;
+    shape->index_count = k;
+}
+
+const DLE_LightShape *light_shape_get(const DLE_LightShapeKind kind, const u32 segments, const f32 param) {
+    const u32 min_segments = kind == LIGHT_SHAPE_CIRCLE || kind == LIGHT_SHAPE_RINGS ? 3 : 1;
+    if(segments < min_segments || segments > LIGHT_SHAPE_MAX_SEGMENTS) {
+        fprintf(stderr, "%s invalid segment count %u\n", __func__, segments);
+        return NULL;
+    }
+    if(kind == LIGHT_SHAPE_RINGS
+        && !(param >= 1 && 1 + U32(param) * segments <= LIGHT_SHAPE_MAX_POINTS)) {
+        fprintf(stderr, "%s invalid ring count %f\n", __func__, param);
+        return NULL;
+    }
+    for(u32 i = 0; i < shape_count; i++) {
+        const DLE_LightShape *shape = shapes[i];
+        // params are keys, compare them bitwise
+        if(shape->kind == kind && shape->segments == segments && memcmp(&shape->param, &param, sizeof(param)) == 0)
+            return shape;
+    }
+    if(shape_count == LIGHT_SHAPES_MAX) {
+        fprintf(stderr, "%s shape cache is full\n", __func__);
+        return NULL;
+    }
+    DLE_LightShape *shape = malloc(sizeof(DLE_LightShape));
+    if(!shape) {
+        fprintf(stderr, "%s failed to allocate a shape\n", __func__);
+        return NULL;
+    }
+    shape->kind = kind;
+    shape->segments = segments;
+    shape->param = param;
+    build_shape(shape);
+    shapes[shape_count++] = shape;
+    return shape;
+}
+
+void light_shapes_free(void) {
+    for(u32 i = 0; i < shape_count; i++)
+        free_and_null(shapes[i]);
+    shape_count = 0;
+}
+
+DLE_LightXform light_xform(
+    const SDL_FPoint origin, const f32 angle_degrees, const f32 width, const f32 length
+) {
+    const f64
+        angle_radians = angle_degrees_to_rads(angle_degrees),
+        s = sin(angle_radians),
+        c = cos(angle_radians);
+    return (DLE_LightXform) {
+        .m00 = F32(c * width), .m01 = F32(-s * length),
+        .m10 = F32(s * width), .m11 = F32(c * length),
+        .tx = origin.x, .ty = origin.y,
+    };
+}
+
+void light_shape_transform(const DLE_LightShape *shape, const DLE_LightXform *xform, SDL_FPoint *out) {
+    for(u32 i = 0; i < shape->point_count; i++) {
+        const SDL_FPoint p = shape->points[i];
+        out[i] = (SDL_FPoint) {
+            xform->m00 * p.x + xform->m01 * p.y + xform->tx,
+            xform->m10 * p.x + xform->m11 * p.y + xform->ty,
+        };
+    }
+}
+
+void light_shape_verts(
+    const DLE_LightShape *shape, const SDL_FPoint *points,
+    const SDL_Color center, const SDL_Color edge, SDL_Vertex *out
+) {
+    out[0] = (SDL_Vertex) {points[0], center, (SDL_FPoint){0}};
+    for(u32 i = 1; i < shape->point_count; i++)
+        out[i] = (SDL_Vertex) {points[i], edge, (SDL_FPoint){0}};
+}
+
+void cone_lights_transform(
+    const DLE_LightShape *shape, const DLE_ConeLight *lights, const u32 count, SDL_FPoint *points
+) {
+    for(u32 i = 0; i < count; i++) {
+        const DLE_ConeLight *light = &lights[i];
+        const DLE_LightXform xform = light_xform(light->position, light->angle, light->spread, light->length);
+        light_shape_transform(shape, &xform, &points[i * shape->point_count]);
+    }
+}
+
+bool cone_lights_append(
+    DLE_Geometry *geometry, const DLE_LightShape *shape,
+    const DLE_ConeLight *lights, const SDL_FPoint *points, const u32 count,
+    const SDL_Color *center, const SDL_Color edge
+) {
+    if(!geometry_reserve(geometry, shape->point_count * count, shape->index_count * count))
+        return false;
+    for(u32 i = 0; i < count; i++) {
+        const DLE_ConeLight *light = &lights[i];
+        const SDL_Color light_center = center ? *center : (SDL_Color) {
+            light->color.r, light->color.g, light->color.b, U8(light->intensity * 255 + 0.5f),
+        };
+        const int base = I32(geometry->vert_count);
+        light_shape_verts(
+            shape, &points[i * shape->point_count], light_center, edge,
+            &geometry->verts[geometry->vert_count]);
+        geometry->vert_count += shape->point_count;
+        for(u32 j = 0; j < shape->index_count; j++)
+            geometry->indices[geometry->index_count++] = base + shape->indices[j];
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef lighting_example_lightshapes_H
+#define lighting_example_lightshapes_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+
+/* Cached unit light meshes.
+   Shapes are built once per (kind, segments, param) in unit space: point 0
+   is the light's origin at (0, 0) and the shape points up (-y), with a
+   length/radius of 1. A light places its shape with one affine transform
+   (a single sin/cos) and the transformed points are reused by every pass
+   that draws the light, only the vertex colors differ between passes.
+
+     cone    trapezoid from a near edge of half width `param` at the origin
+             to a far edge of half width 1, `segments` far edge segments.
+     fan     circular sector spanning `param` degrees, `segments` arc segments.
+     circle  `segments` sided disc, `param` is unused.
+     rings   `segments` sided disc split into `param` concentric rings of
+             equal width, so vertex colors can follow a radial falloff.
+             Ring k's points are at radius k / rings.
+*/
+
+#define LIGHT_SHAPE_MAX_SEGMENTS 64
+#define LIGHT_SHAPE_MAX_POINTS (LIGHT_SHAPE_MAX_SEGMENTS + 4)
+#define LIGHT_SHAPE_MAX_INDICES (LIGHT_SHAPE_MAX_POINTS * 6)
+#define LIGHT_SHAPES_MAX 16
+
+typedef enum {
+    LIGHT_SHAPE_CONE,
+    LIGHT_SHAPE_FAN,
+    LIGHT_SHAPE_CIRCLE,
+    LIGHT_SHAPE_RINGS,
+} DLE_LightShapeKind;
+
+typedef struct {
+    DLE_LightShapeKind kind;
+    u32 segments;
+    f32 param;
+    SDL_FPoint points[LIGHT_SHAPE_MAX_POINTS];
+    int indices[LIGHT_SHAPE_MAX_INDICES];
+    u32 point_count;
+    u32 index_count;
+} DLE_LightShape;
+
+// 2x3 affine transform, points map to (m00 x + m01 y + tx, m10 x + m11 y + ty).
+typedef struct {
+    f32 m00, m01, m10, m11;
+    f32 tx, ty;
+} DLE_LightXform;
+
+// returns NULL if segments (or the ring count) is out of range or the cache
+// is full. Rings shapes must fit LIGHT_SHAPE_MAX_POINTS.
+const DLE_LightShape *light_shape_get(const DLE_LightShapeKind kind, const u32 segments, const f32 param);
+void light_shapes_free(void);
+
+// Scales the unit shape by (width, length), rotates it by angle_degrees
+// (the same direction as rotate_point) and moves the origin to `origin`.
+DLE_LightXform light_xform(
+    const SDL_FPoint origin, const f32 angle_degrees, const f32 width, const f32 length);
+// out holds shape->point_count points.
+void light_shape_transform(const DLE_LightShape *shape, const DLE_LightXform *xform, SDL_FPoint *out);
+// point 0 gets the center color, every other point the edge color.
+void light_shape_verts(
+    const DLE_LightShape *shape, const SDL_FPoint *points,
+    const SDL_Color center, const SDL_Color edge, SDL_Vertex *out);
+
+/* Cone lights.
+   Every light is drawn with the same unit shape, so a pass over any number
+   of lights is one vertex buffer and one draw call.
+*/
+typedef struct {
+    SDL_FPoint position;
+    f32 angle;       // degrees, same direction as rotate_point, 0 points up
+    f32 length;
+    f32 spread;      // half width of the far edge
+    SDL_Color color; // color pass tint, alpha is ignored
+    f32 intensity;   // 0..1, color pass alpha at the light's origin
+} DLE_ConeLight;
+
+// points holds shape->point_count points per light.
+void cone_lights_transform(
+    const DLE_LightShape *shape, const DLE_ConeLight *lights, const u32 count, SDL_FPoint *points);
+// Appends one pass over every light to geometry. center = NULL gives each
+// light's origin its color with intensity as alpha. Returns false if the
+// geometry could not grow.
+bool cone_lights_append(
+    DLE_Geometry *geometry, const DLE_LightShape *shape,
+    const DLE_ConeLight *lights, const SDL_FPoint *points, const u32 count,
+    const SDL_Color *center, const SDL_Color edge);
+
+#endif
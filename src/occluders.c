@@ -0,0 +1,690 @@
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "occluders.h"
+
+
+static bool occluders_reserve(DLE_Occluders *occluders, const u32 extra) {
+    const u32 needed = occluders->count + extra;
+    if(needed <= occluders->capacity)
+        return true;
+    const u32 capacity = needed > occluders->capacity * 2 ? needed : (occluders->capacity ? occluders->capacity * 2 : 16);
+    DLE_Segment *grown = realloc(occluders->segments, sizeof(DLE_Segment) * capacity);
+    if(!grown) {
+        fprintf(stderr, "%s failed to grow to %u segments\n", __func__, capacity);
+        return false;
+    }
+    occluders->segments = grown;
+    occluders->capacity = capacity;
+    return true;
+}
+
+bool occluders_add_segment(DLE_Occluders *occluders, const SDL_FPoint a, const SDL_FPoint b) {
+    if(!occluders_reserve(occluders, 1))
+        return false;
+    occluders->segments[occluders->count++] = (DLE_Segment) {a, b};
+    return true;
+}
+
+bool occluders_add_segments(DLE_Occluders *occluders, const DLE_Segment *segments, const u32 count) {
+    if(!occluders_reserve(occluders, count))
+        return false;
+    memcpy(&occluders->segments[occluders->count], segments, sizeof(DLE_Segment) * count);
+    occluders->count += count;
+    return true;
+}
+
+bool occluders_add_rect(DLE_Occluders *occluders, const SDL_FRect *rect) {
+    const f32 x1 = rect->x, y1 = rect->y, x2 = rect->x + rect->w, y2 = rect->y + rect->h;
+    return occluders_add_segment(occluders, (SDL_FPoint) {x1, y1}, (SDL_FPoint) {x2, y1})
+        && occluders_add_segment(occluders, (SDL_FPoint) {x2, y1}, (SDL_FPoint) {x2, y2})
+        && occluders_add_segment(occluders, (SDL_FPoint) {x2, y2}, (SDL_FPoint) {x1, y2})
+        && occluders_add_segment(occluders, (SDL_FPoint) {x1, y2}, (SDL_FPoint) {x1, y1});
+}
+
+void occluders_free(DLE_Occluders *occluders) {
+    free_and_null(occluders->segments);
+    occluders->count = 0;
+    occluders->capacity = 0;
+}
+
+void light_fans_free(DLE_LightFans *fans) {
+    free_and_null(fans->points);
+    free_and_null(fans->reach);
+    free_and_null(fans->firsts);
+    *fans = (DLE_LightFans) {0};
+}
+
+static bool light_fans_reserve(DLE_LightFans *fans, const u32 extra_points) {
+    // Room for extra_points more points and one more fan (plus the end
+    // marker of the fan after it).
+    const u32 points_needed = fans->point_count + extra_points;
+    if(points_needed > fans->point_capacity) {
+        const u32 capacity = points_needed > fans->point_capacity * 2 ? points_needed : fans->point_capacity * 2;
+        SDL_FPoint *points = realloc(fans->points, sizeof(SDL_FPoint) * capacity);
+        if(points)
+            fans->points = points;
+        f32 *reach = realloc(fans->reach, sizeof(f32) * capacity);
+        if(reach)
+            fans->reach = reach;
+        if(!points || !reach) {
+            fprintf(stderr, "%s failed to grow to %u points\n", __func__, capacity);
+            return false;
+        }
+        fans->point_capacity = capacity;
+    }
+    if(fans->fan_count + 2 > fans->fan_capacity) {
+        const u32 capacity = fans->fan_capacity ? fans->fan_capacity * 2 : 16;
+        u32 *firsts = realloc(fans->firsts, sizeof(u32) * capacity);
+        if(!firsts) {
+            fprintf(stderr, "%s failed to grow to %u fans\n", __func__, capacity);
+            return false;
+        }
+        fans->firsts = firsts;
+        fans->fan_capacity = capacity;
+    }
+    return true;
+}
+
+/* Sweep state, shared by every clip call. Angles are relative to the fan's
+   reference direction (the bisector of its boundary), so a fan covers at
+   most [-90, 90] degrees and never wraps around.
+
+   The segments under the sweep ray are kept in a binary heap, nearest
+   first. Two segments keep their order along the ray until they end or
+   cross, so besides the endpoint events every heap slot holds a
+   certificate: the angle at which its segment crosses in front of its
+   parent's, if that happens before either ends. Certificates are kept in a
+   second heap, soonest first, and a failing one swaps the pair. Segments
+   that cross while neither is the other's parent cost nothing.
+*/
+typedef struct {
+    f64 a, b; // angles of p and q, a < b
+    SDL_FPoint p, q;
+    f64 fails; // angle of its certificate
+    u32 slot;      // in sweep_heap, SWEEP_NONE while not under the sweep ray
+    u32 fail_slot; // in sweep_failures, SWEEP_NONE without a certificate
+} DLE_SweepSegment;
+
+typedef struct {
+    f64 angle;
+    i32 vertex; // fan index of a boundary point, -1 for occluder endpoints
+} DLE_SweepEvent;
+
+#define SWEEP_EPSILON 1e-7
+#define SWEEP_NONE U32(-1)
+
+static DLE_SweepSegment *sweep_segments = NULL;
+static u32 *sweep_heap = NULL;     // segments under the sweep ray, nearest first
+static u32 *sweep_failures = NULL; // segments with a certificate, soonest first
+static u32 *sweep_ends = NULL;     // segments by end angle
+static u32 sweep_segment_capacity = 0;
+static DLE_SweepEvent *sweep_events = NULL;
+static u32 sweep_event_capacity = 0;
+static f64 *sweep_angles = NULL;
+static u32 sweep_angle_capacity = 0;
+
+static bool sweep_reserve(const u32 segments, const u32 fan_points) {
+    if(segments > sweep_segment_capacity) {
+        DLE_SweepSegment *grown = realloc(sweep_segments, sizeof(DLE_SweepSegment) * segments);
+        if(grown)
+            sweep_segments = grown;
+        u32 *heap = realloc(sweep_heap, sizeof(u32) * segments);
+        if(heap)
+            sweep_heap = heap;
+        u32 *failures = realloc(sweep_failures, sizeof(u32) * segments);
+        if(failures)
+            sweep_failures = failures;
+        u32 *ends = realloc(sweep_ends, sizeof(u32) * segments);
+        if(ends)
+            sweep_ends = ends;
+        if(!grown || !heap || !failures || !ends) {
+            fprintf(stderr, "%s failed to grow to %u segments\n", __func__, segments);
+            return false;
+        }
+        sweep_segment_capacity = segments;
+    }
+    const u32 events = segments * 2 + fan_points;
+    if(events > sweep_event_capacity) {
+        DLE_SweepEvent *grown = realloc(sweep_events, sizeof(DLE_SweepEvent) * events);
+        if(!grown) {
+            fprintf(stderr, "%s failed to grow to %u events\n", __func__, events);
+            return false;
+        }
+        sweep_events = grown;
+        sweep_event_capacity = events;
+    }
+    if(fan_points > sweep_angle_capacity) {
+        f64 *grown = realloc(sweep_angles, sizeof(f64) * fan_points);
+        if(!grown) {
+            fprintf(stderr, "%s failed to grow to %u points\n", __func__, fan_points);
+            return false;
+        }
+        sweep_angles = grown;
+        sweep_angle_capacity = fan_points;
+    }
+    return true;
+}
+
+void occluders_sweep_free(void) {
+    free_and_null(sweep_segments);
+    free_and_null(sweep_heap);
+    free_and_null(sweep_failures);
+    free_and_null(sweep_ends);
+    sweep_segment_capacity = 0;
+    free_and_null(sweep_events);
+    sweep_event_capacity = 0;
+    free_and_null(sweep_angles);
+    sweep_angle_capacity = 0;
+}
+
+static int compare_events(const void *a, const void *b) {
+    const DLE_SweepEvent *ea = a, *eb = b;
+    if(ea->angle < eb->angle)
+        return -1;
+    return ea->angle > eb->angle;
+}
+
+static int compare_segments(const void *a, const void *b) {
+    const DLE_SweepSegment *sa = a, *sb = b;
+    if(sa->a < sb->a)
+        return -1;
+    return sa->a > sb->a;
+}
+
+static int compare_ends(const void *a, const void *b) {
+    const f64 ea = sweep_segments[*(const u32 *)a].b, eb = sweep_segments[*(const u32 *)b].b;
+    if(ea < eb)
+        return -1;
+    return ea > eb;
+}
+
+static inline f64 cross(const f64 ax, const f64 ay, const f64 bx, const f64 by) {
+    return ax * by - ay * bx;
+}
+
+static inline f64 ray_line(
+    const SDL_FPoint o, const f64 dx, const f64 dy, const SDL_FPoint p, const SDL_FPoint q
+) {
+    // distance along the unit direction (dx, dy) from o to the line through
+    // p and q, INFINITY if they are parallel.
+    const f64 ex = q.x - p.x, ey = q.y - p.y;
+    const f64 den = cross(dx, dy, ex, ey);
+    if(fabs(den) < 1e-12)
+        return INFINITY;
+    return cross(p.x - o.x, p.y - o.y, ex, ey) / den;
+}
+
+/* One fan's sweep. The boundary is emitted span by span, a span being an
+   angular range over which both the fan edge and the nearest occluder are
+   fixed lines.
+*/
+typedef struct {
+    SDL_FPoint o;
+    f64 rx, ry; // unit reference direction
+    f64 angle;  // of the sweep ray
+    f64 dx, dy; // its unit direction
+    u32 active_count;  // in sweep_heap
+    u32 failure_count; // in sweep_failures
+    DLE_LightFans *out;
+    u32 first;  // index of the fan's origin in out
+    bool failed;
+} DLE_Sweep;
+
+static inline f64 sweep_angle(const DLE_Sweep *sweep, const f64 x, const f64 y) {
+    const f64 vx = x - sweep->o.x, vy = y - sweep->o.y;
+    return atan2(cross(sweep->rx, sweep->ry, vx, vy), sweep->rx * vx + sweep->ry * vy);
+}
+
+static inline void sweep_dir(const DLE_Sweep *sweep, const f64 angle, f64 *dx, f64 *dy) {
+    const f64 s = sin(angle), c = cos(angle);
+    *dx = sweep->rx * c - sweep->ry * s;
+    *dy = sweep->rx * s + sweep->ry * c;
+}
+
+static void sweep_push(DLE_Sweep *sweep, const SDL_FPoint p, const f32 reach) {
+    // skips points that repeat the fan's previous boundary point.
+    DLE_LightFans *out = sweep->out;
+    if(out->point_count > sweep->first + 1) {
+        const SDL_FPoint last = out->points[out->point_count - 1];
+        if(fabsf(last.x - p.x) < 1e-3f && fabsf(last.y - p.y) < 1e-3f)
+            return;
+    }
+    if(out->point_count == out->point_capacity && !light_fans_reserve(out, 64)) {
+        sweep->failed = true;
+        return;
+    }
+    out->points[out->point_count] = p;
+    out->reach[out->point_count] = reach;
+    out->point_count++;
+}
+
+static bool line_crossing(
+    const SDL_FPoint p1, const SDL_FPoint q1, const SDL_FPoint p2, const SDL_FPoint q2, f64 *x, f64 *y
+) {
+    // returns false if the lines are parallel.
+    const f64 ex = q1.x - p1.x, ey = q1.y - p1.y;
+    const f64 fx = q2.x - p2.x, fy = q2.y - p2.y;
+    const f64 den = cross(ex, ey, fx, fy);
+    if(fabs(den) < 1e-12)
+        return false;
+    const f64 t = cross(p2.x - p1.x, p2.y - p1.y, fx, fy) / den;
+    *x = p1.x + ex * t;
+    *y = p1.y + ey * t;
+    return true;
+}
+
+static void sweep_turn(DLE_Sweep *sweep, const f64 angle) {
+    // moves the sweep ray forward to angle.
+    if(angle <= sweep->angle)
+        return;
+    sweep->angle = angle;
+    sweep_dir(sweep, angle, &sweep->dx, &sweep->dy);
+}
+
+static bool nearer(const DLE_Sweep *sweep, const DLE_SweepSegment *s, const DLE_SweepSegment *t) {
+    // true if s is in front of t just past the sweep ray.
+    const f64
+        ds = ray_line(sweep->o, sweep->dx, sweep->dy, s->p, s->q),
+        dt = ray_line(sweep->o, sweep->dx, sweep->dy, t->p, t->q);
+    if(fabs(ds - dt) > 1e-9 * (ds + dt))
+        return ds < dt;
+    // they meet on the ray, and lines meet only once: compare them halfway
+    // to the first end
+    f64 dx, dy;
+    sweep_dir(sweep, (sweep->angle + SDL_min(s->b, t->b)) * 0.5, &dx, &dy);
+    return ray_line(sweep->o, dx, dy, s->p, s->q) < ray_line(sweep->o, dx, dy, t->p, t->q);
+}
+
+static void failures_place(const u32 i, const u32 segment) {
+    sweep_failures[i] = segment;
+    sweep_segments[segment].fail_slot = i;
+}
+
+static void failures_sift(const DLE_Sweep *sweep, u32 i) {
+    const u32 segment = sweep_failures[i];
+    const f64 fails = sweep_segments[segment].fails;
+    while(i > 0 && fails < sweep_segments[sweep_failures[(i - 1) / 2]].fails) {
+        failures_place(i, sweep_failures[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    for(;;) {
+        u32 child = 2 * i + 1;
+        if(child >= sweep->failure_count)
+            break;
+        if(child + 1 < sweep->failure_count
+            && sweep_segments[sweep_failures[child + 1]].fails < sweep_segments[sweep_failures[child]].fails)
+            child++;
+        if(!(sweep_segments[sweep_failures[child]].fails < fails))
+            break;
+        failures_place(i, sweep_failures[child]);
+        i = child;
+    }
+    failures_place(i, segment);
+}
+
+static void set_certificate(DLE_Sweep *sweep, const u32 segment, const f64 fails) {
+    // fails = INFINITY drops the segment's certificate.
+    DLE_SweepSegment *s = &sweep_segments[segment];
+    const u32 i = s->fail_slot;
+    s->fails = fails;
+    if(i == SWEEP_NONE) {
+        if(isinf(fails))
+            return;
+        failures_place(sweep->failure_count++, segment);
+        failures_sift(sweep, sweep->failure_count - 1);
+        return;
+    }
+    if(isinf(fails)) {
+        s->fail_slot = SWEEP_NONE;
+        const u32 last = sweep_failures[--sweep->failure_count];
+        if(i == sweep->failure_count)
+            return;
+        failures_place(i, last);
+    }
+    failures_sift(sweep, i);
+}
+
+static void certify(DLE_Sweep *sweep, const u32 i) {
+    // renews the certificate of heap slot i against its parent. Skips
+    // slots a sift has moved the segment out of but not yet refilled.
+    if(i >= sweep->active_count || sweep_segments[sweep_heap[i]].slot != i)
+        return;
+    const DLE_SweepSegment *s = &sweep_segments[sweep_heap[i]], *parent = &sweep_segments[sweep_heap[i ? (i - 1) / 2 : 0]];
+    f64 fails = INFINITY, x, y;
+    if(i && line_crossing(s->p, s->q, parent->p, parent->q, &x, &y)) {
+        const f64 angle = sweep_angle(sweep, x, y), end = SDL_min(s->b, parent->b);
+        if(angle > sweep->angle + SWEEP_EPSILON) {
+            if(angle < end - SWEEP_EPSILON)
+                fails = angle;
+        } else if(angle > sweep->angle - SWEEP_EPSILON) {
+            // they cross on the sweep ray, give or take rounding: fail now
+            // if s comes out in front
+            f64 dx, dy;
+            sweep_dir(sweep, (sweep->angle + end) * 0.5, &dx, &dy);
+            if(ray_line(sweep->o, dx, dy, s->p, s->q) < ray_line(sweep->o, dx, dy, parent->p, parent->q))
+                fails = sweep->angle;
+        }
+    }
+    set_certificate(sweep, sweep_heap[i], fails);
+}
+
+static void active_place(DLE_Sweep *sweep, const u32 i, const u32 segment) {
+    // the slot's segment and so its children's parent changed.
+    sweep_heap[i] = segment;
+    sweep_segments[segment].slot = i;
+    certify(sweep, i);
+    certify(sweep, 2 * i + 1);
+    certify(sweep, 2 * i + 2);
+}
+
+static void active_sift(DLE_Sweep *sweep, u32 i) {
+    const u32 segment = sweep_heap[i];
+    const DLE_SweepSegment *s = &sweep_segments[segment];
+    while(i > 0 && nearer(sweep, s, &sweep_segments[sweep_heap[(i - 1) / 2]])) {
+        active_place(sweep, i, sweep_heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    for(;;) {
+        u32 child = 2 * i + 1;
+        if(child >= sweep->active_count)
+            break;
+        if(child + 1 < sweep->active_count
+            && nearer(sweep, &sweep_segments[sweep_heap[child + 1]], &sweep_segments[sweep_heap[child]]))
+            child++;
+        if(!nearer(sweep, &sweep_segments[sweep_heap[child]], s))
+            break;
+        active_place(sweep, i, sweep_heap[child]);
+        i = child;
+    }
+    active_place(sweep, i, segment);
+}
+
+static void active_insert(DLE_Sweep *sweep, const u32 segment) {
+    sweep_heap[sweep->active_count] = segment;
+    sweep->active_count++;
+    active_sift(sweep, sweep->active_count - 1);
+}
+
+static void active_remove(DLE_Sweep *sweep, const u32 segment) {
+    DLE_SweepSegment *s = &sweep_segments[segment];
+    const u32 i = s->slot;
+    s->slot = SWEEP_NONE;
+    set_certificate(sweep, segment, INFINITY);
+    const u32 last = sweep_heap[--sweep->active_count];
+    if(i == sweep->active_count)
+        return;
+    sweep_heap[i] = last;
+    sweep_segments[last].slot = i;
+    active_sift(sweep, i);
+}
+
+static void fail_certificate(DLE_Sweep *sweep) {
+    // the soonest certificate fails: its segment passes in front of its
+    // parent.
+    const u32 segment = sweep_failures[0];
+    const u32 i = sweep_segments[segment].slot, parent = (i - 1) / 2;
+    sweep_turn(sweep, sweep_segments[segment].fails);
+    const u32 behind = sweep_heap[parent];
+    sweep_heap[i] = behind;
+    sweep_segments[behind].slot = i;
+    active_place(sweep, parent, segment);
+    active_place(sweep, i, behind);
+}
+
+static inline const DLE_SweepSegment *active_nearest(const DLE_Sweep *sweep) {
+    return sweep->active_count ? &sweep_segments[sweep_heap[0]] : NULL;
+}
+
+static void emit_span(
+    DLE_Sweep *sweep, const SDL_FPoint c_p, const SDL_FPoint c_q,
+    const f64 a0, const f64 a1, const SDL_FPoint *exact[2],
+    const DLE_SweepSegment *nearest
+) {
+    // the boundary over the span is the nearer of the fan edge (c_p, c_q)
+    // and the nearest occluder, the two lines may cross once. exact holds
+    // the fan vertices at the span's ends, if any.
+    bool occluded[2];
+    for(u32 end = 0; end < 2; end++) {
+        f64 dx, dy;
+        sweep_dir(sweep, end ? a1 : a0, &dx, &dy);
+        const f64 c = ray_line(sweep->o, dx, dy, c_p, c_q);
+        const f64 s = nearest ? ray_line(sweep->o, dx, dy, nearest->p, nearest->q) : INFINITY;
+        occluded[end] = s < c;
+        f64 x, y;
+        if(end && occluded[0] != occluded[1] && line_crossing(c_p, c_q, nearest->p, nearest->q, &x, &y))
+            sweep_push(sweep, (SDL_FPoint) {F32(x), F32(y)}, 1);
+        if(occluded[end])
+            sweep_push(sweep, (SDL_FPoint) {F32(sweep->o.x + dx * s), F32(sweep->o.y + dy * s)}, F32(s / c));
+        else if(exact[end])
+            sweep_push(sweep, *exact[end], 1);
+        else
+            sweep_push(sweep, (SDL_FPoint) {F32(sweep->o.x + dx * c), F32(sweep->o.y + dy * c)}, 1);
+    }
+}
+
+static bool clip_fan(
+    const DLE_Occluders *occluders, const SDL_FPoint *fan, const u32 n, DLE_LightFans *out
+) {
+    const SDL_FPoint o = fan[0];
+    f32 x1 = o.x, y1 = o.y, x2 = o.x, y2 = o.y;
+    for(u32 i = 1; i < n; i++) {
+        x1 = SDL_min(x1, fan[i].x);
+        y1 = SDL_min(y1, fan[i].y);
+        x2 = SDL_max(x2, fan[i].x);
+        y2 = SDL_max(y2, fan[i].y);
+    }
+    DLE_Sweep sweep = {
+        .o = o,
+        .out = out,
+        .first = out->point_count,
+    };
+    { // reference direction: the bisector of the first and last boundary
+      // directions u and v, taken as the normal of the chord v - u rather
+      // than u + v. Cones span exactly 180 degrees (their near edge runs
+      // through the origin), where u + v is nothing but rounding noise.
+        f64 ux = fan[1].x - o.x, uy = fan[1].y - o.y;
+        f64 vx = fan[n - 1].x - o.x, vy = fan[n - 1].y - o.y;
+        const f64 u_len = sqrt(ux * ux + uy * uy), v_len = sqrt(vx * vx + vy * vy);
+        if(u_len < 1e-9 || v_len < 1e-9)
+            return true;
+        ux /= u_len; uy /= u_len;
+        vx /= v_len; vy /= v_len;
+        f64 rx = uy - vy, ry = vx - ux;
+        const f64 r_len = sqrt(rx * rx + ry * ry);
+        if(r_len < 1e-9)
+            return true; // u == v, no area
+        // towards the rest of the boundary
+        const f64
+            wx = n > 3 ? fan[n / 2].x - o.x : ux + vx,
+            wy = n > 3 ? fan[n / 2].y - o.y : uy + vy;
+        const f64 side = rx * wx + ry * wy < 0 ? -1 : 1;
+        sweep.rx = side * rx / r_len;
+        sweep.ry = side * ry / r_len;
+    }
+
+    if(!sweep_reserve(occluders->count, n) || !light_fans_reserve(out, n))
+        return false;
+    for(u32 i = 1; i < n; i++)
+        sweep_angles[i] = sweep_angle(&sweep, fan[i].x, fan[i].y);
+    const f64 lo = sweep_angles[1], hi = sweep_angles[n - 1];
+
+    // occluders that can overlap the fan, clamped to its angular range
+    u32 segment_count = 0;
+    for(u32 i = 0; i < occluders->count; i++) {
+        const DLE_Segment *segment = &occluders->segments[i];
+        if(SDL_max(segment->a.x, segment->b.x) < x1 || SDL_min(segment->a.x, segment->b.x) > x2
+            || SDL_max(segment->a.y, segment->b.y) < y1 || SDL_min(segment->a.y, segment->b.y) > y2)
+            continue;
+        // segments touching the origin can't hide anything from it (every
+        // ray meets them at distance 0)
+        {
+            const f32 ex = segment->b.x - segment->a.x, ey = segment->b.y - segment->a.y;
+            const f32 len_sq = ex * ex + ey * ey;
+            const f32 t = len_sq > 0 ? SDL_min(SDL_max(((o.x - segment->a.x) * ex + (o.y - segment->a.y) * ey) / len_sq, 0), 1) : 0;
+            if(dist_sq(o.x, o.y, segment->a.x + ex * t, segment->a.y + ey * t) < 1e-6f)
+                continue;
+        }
+        f64 a = sweep_angle(&sweep, segment->a.x, segment->a.y), b = sweep_angle(&sweep, segment->b.x, segment->b.y);
+        SDL_FPoint p = segment->a, q = segment->b;
+        if(a > b) {
+            const f64 t = a; a = b; b = t;
+            p = segment->b; q = segment->a;
+        }
+        if(b - a > 180 * PI_OVER_180) {
+            // the segment passes behind the origin and covers [b, 180] and
+            // [-180, a], at most one of which reaches into the fan
+            const f64 t = a;
+            a = b < hi ? b : -180 * PI_OVER_180;
+            b = b < hi ? 180 * PI_OVER_180 : t;
+        }
+        // edge-on segments are covered by their neighbours
+        if(b - a < SWEEP_EPSILON || b <= lo || a >= hi)
+            continue;
+        sweep_segments[segment_count++] = (DLE_SweepSegment) {
+            .a = SDL_max(a, lo), .b = SDL_min(b, hi), .p = p, .q = q,
+            .fails = INFINITY, .slot = SWEEP_NONE, .fail_slot = SWEEP_NONE,
+        };
+    }
+
+    out->firsts[out->fan_count] = sweep.first;
+    if(!segment_count) {
+        // nothing in the way, the fan is visible as it is
+        for(u32 i = 0; i < n; i++) {
+            out->points[out->point_count] = fan[i];
+            out->reach[out->point_count] = i ? 1 : 0;
+            out->point_count++;
+        }
+        out->firsts[++out->fan_count] = out->point_count;
+        return true;
+    }
+
+    u32 event_count = 0;
+    for(u32 i = 1; i < n; i++)
+        sweep_events[event_count++] = (DLE_SweepEvent) {sweep_angles[i], I32(i)};
+    for(u32 i = 0; i < segment_count; i++) {
+        sweep_events[event_count++] = (DLE_SweepEvent) {sweep_segments[i].a, -1};
+        sweep_events[event_count++] = (DLE_SweepEvent) {sweep_segments[i].b, -1};
+    }
+    qsort(sweep_events, event_count, sizeof(DLE_SweepEvent), compare_events);
+    qsort(sweep_segments, segment_count, sizeof(DLE_SweepSegment), compare_segments);
+    for(u32 i = 0; i < segment_count; i++)
+        sweep_ends[i] = i;
+    qsort(sweep_ends, segment_count, sizeof(u32), compare_ends);
+    { // merge events closer than SWEEP_EPSILON, keeping fan vertices
+        u32 merged = 0;
+        for(u32 i = 0; i < event_count; i++) {
+            if(merged && sweep_events[i].angle - sweep_events[merged - 1].angle < SWEEP_EPSILON) {
+                if(sweep_events[i].vertex >= 0)
+                    sweep_events[merged - 1].vertex = sweep_events[i].vertex;
+                continue;
+            }
+            sweep_events[merged++] = sweep_events[i];
+        }
+        event_count = merged;
+    }
+
+    out->points[out->point_count] = o;
+    out->reach[out->point_count] = 0;
+    out->point_count++;
+    sweep.angle = -INFINITY;
+    u32 next_segment = 0, next_end = 0;
+    u32 edge = 1; // fan boundary edge (edge, edge + 1) under the sweep
+    for(u32 k = 0; k + 1 < event_count; k++) {
+        const f64 a0 = sweep_events[k].angle, a1 = sweep_events[k + 1].angle;
+        while(sweep.failure_count && sweep_segments[sweep_failures[0]].fails <= a0 + SWEEP_EPSILON)
+            fail_certificate(&sweep);
+        sweep_turn(&sweep, a0);
+        for(; next_end < segment_count && sweep_segments[sweep_ends[next_end]].b <= a0 + SWEEP_EPSILON; next_end++) {
+            if(sweep_segments[sweep_ends[next_end]].slot != SWEEP_NONE)
+                active_remove(&sweep, sweep_ends[next_end]);
+        }
+        for(; next_segment < segment_count && sweep_segments[next_segment].a <= a0 + SWEEP_EPSILON; next_segment++) {
+            if(sweep_segments[next_segment].b > a0 + SWEEP_EPSILON)
+                active_insert(&sweep, next_segment);
+        }
+        while(edge + 2 < n && sweep_angles[edge + 1] <= a0 + SWEEP_EPSILON)
+            edge++;
+        const i32 v0 = sweep_events[k].vertex, v1 = sweep_events[k + 1].vertex;
+
+        // split the interval wherever a certificate failure changes the
+        // nearest occluder
+        f64 a = a0;
+        for(;;) {
+            const bool last = !(sweep.failure_count
+                && sweep_segments[sweep_failures[0]].fails < a1 - SWEEP_EPSILON);
+            const DLE_SweepSegment *nearest = active_nearest(&sweep);
+            f64 b = a1;
+            if(!last) {
+                b = sweep_segments[sweep_failures[0]].fails;
+                fail_certificate(&sweep);
+                if(active_nearest(&sweep) == nearest || b - a <= SWEEP_EPSILON)
+                    continue;
+            }
+            const SDL_FPoint *exact[2] = {
+                a > a0 || v0 != I32(edge) ? NULL : &fan[edge],
+                !last || v1 != I32(edge + 1) ? NULL : &fan[edge + 1],
+            };
+            emit_span(&sweep, fan[edge], fan[edge + 1], a, b, exact, nearest);
+            if(last)
+                break;
+            a = b;
+        }
+    }
+    if(sweep.failed)
+        return false;
+
+    if(out->point_count - sweep.first < 3) {
+        // no visible area
+        out->point_count = sweep.first;
+        return true;
+    }
+    out->firsts[++out->fan_count] = out->point_count;
+    return true;
+}
+
+bool occluders_clip_fans(
+    const DLE_Occluders *occluders,
+    const SDL_FPoint *fans, const u32 fan_points, const u32 fan_count,
+    DLE_LightFans *out
+) {
+    for(u32 i = 0; i < fan_count; i++) {
+        if(!clip_fan(occluders, &fans[i * fan_points], fan_points, out))
+            return false;
+    }
+    return true;
+}
+
+static inline u8 lerp_channel(const u8 from, const u8 to, const f32 t) {
+    return U8(from + (to - from) * t + 0.5f);
+}
+
+bool light_fans_append(
+    DLE_Geometry *geometry, const DLE_LightFans *fans, const SDL_Color center, const SDL_Color edge
+) {
+    if(!geometry_reserve(geometry, fans->point_count, 3 * (fans->point_count - 2 * fans->fan_count)))
+        return false;
+    for(u32 f = 0; f < fans->fan_count; f++) {
+        const u32 first = fans->firsts[f], end = fans->firsts[f + 1];
+        const int base = I32(geometry->vert_count);
+        for(u32 i = first; i < end; i++) {
+            const f32 reach = i == first ? 0 : SDL_min(SDL_max(fans->reach[i], 0), 1);
+            const SDL_Color color = {
+                lerp_channel(center.r, edge.r, reach),
+                lerp_channel(center.g, edge.g, reach),
+                lerp_channel(center.b, edge.b, reach),
+                lerp_channel(center.a, edge.a, reach),
+            };
+            geometry->verts[geometry->vert_count++] = (SDL_Vertex) {fans->points[i], color, (SDL_FPoint){0}};
+        }
+        for(u32 i = 1; i + 1 < end - first; i++) {
+            geometry->indices[geometry->index_count++] = base;
+            geometry->indices[geometry->index_count++] = base + I32(i);
+            geometry->indices[geometry->index_count++] = base + I32(i + 1);
+        }
+    }
+    return true;
+}
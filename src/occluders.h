@@ -0,0 +1,77 @@
+#ifndef lighting_example_occluders_H
+#define lighting_example_occluders_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+
+/* Occluders and light visibility.
+   Occluders are line segments, rects are registered as their four edges.
+   A light's unclipped shape is a fan: point 0 is the light's origin and the
+   remaining points are its boundary, star-shaped around the origin, in
+   increasing angle and spanning at most 180 degrees (every cone and fan
+   light shape). occluders_clip_fans cuts each fan down to the part the
+   origin can see with an angular sweep over the occluder endpoints that
+   keeps the segments under the sweep ray in a heap, nearest first. A fan
+   with n points costs a pass over the occluders to find the k near it,
+   O((n + k) log(n + k)) for the sweep and O(log k) more for each crossing
+   the heap has to reorder.
+*/
+
+typedef struct {
+    SDL_FPoint a, b;
+} DLE_Segment;
+
+typedef struct {
+    DLE_Segment *segments;
+    u32 count;
+    u32 capacity;
+} DLE_Occluders;
+
+// The add functions return false if the set could not grow.
+bool occluders_add_segment(DLE_Occluders *occluders, const SDL_FPoint a, const SDL_FPoint b);
+bool occluders_add_segments(DLE_Occluders *occluders, const DLE_Segment *segments, const u32 count);
+bool occluders_add_rect(DLE_Occluders *occluders, const SDL_FRect *rect);
+void occluders_free(DLE_Occluders *occluders);
+
+static inline void occluders_clear(DLE_Occluders *occluders) {
+    occluders->count = 0;
+}
+
+/* Clipped fans, laid out back to back. reach is the distance of a boundary
+   point from the origin relative to the unclipped shape's boundary in the
+   same direction: 1 where nothing is in the way.
+*/
+typedef struct {
+    SDL_FPoint *points;
+    f32 *reach;
+    u32 point_count;
+    u32 point_capacity;
+    u32 *firsts;      // fan i is points [firsts[i], firsts[i + 1])
+    u32 fan_count;
+    u32 fan_capacity;
+} DLE_LightFans;
+
+void light_fans_free(DLE_LightFans *fans);
+
+static inline void light_fans_clear(DLE_LightFans *fans) {
+    fans->point_count = 0;
+    fans->fan_count = 0;
+}
+
+// fans holds fan_count fans of fan_points points each. Fans with no visible
+// area are dropped. Returns false if out could not grow.
+bool occluders_clip_fans(
+    const DLE_Occluders *occluders,
+    const SDL_FPoint *fans, const u32 fan_points, const u32 fan_count,
+    DLE_LightFans *out);
+// frees the sweep's scratch buffers.
+void occluders_sweep_free(void);
+// Appends every fan to geometry as a triangle fan. Origins get the center
+// color, boundary points the center color lerped towards edge by reach.
+// Returns false if the geometry could not grow.
+bool light_fans_append(
+    DLE_Geometry *geometry, const DLE_LightFans *fans, const SDL_Color center, const SDL_Color edge);
+
+#endif
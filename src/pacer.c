@@ -0,0 +1,72 @@
+
+#include <stdio.h>
+
+#include "pacer.h"
+
+
+void frame_pacer_init(DLE_FramePacer *pacer, const f64 target_fps, const f64 spin_us) {
+    const f64 freq = F64(SDL_GetPerformanceFrequency());
+    const u64 period = U64(freq / target_fps + 0.5);
+    const u64 max_spin = U64(F64(period) * PACER_MAX_SPIN_FRACTION);
+    const u64 base_spin = SDL_min(U64(freq * spin_us / 1e6 + 0.5), max_spin);
+    *pacer = (DLE_FramePacer) {
+        .period = period,
+        .base_spin = base_spin,
+        .max_spin = max_spin,
+        .spin = base_spin,
+    };
+}
+
+static inline void record_late(DLE_FramePacer *pacer, const u64 late) {
+    if(late > pacer->worst_late)
+        pacer->worst_late = late;
+}
+
+bool frame_pacer_wait(DLE_FramePacer *pacer) {
+    u64 now = SDL_GetPerformanceCounter();
+    pacer->frames++;
+    if(!pacer->started) {
+        pacer->started = true;
+        pacer->deadline = now + pacer->period;
+        return true;
+    }
+    if(now >= pacer->deadline) {
+        pacer->missed++;
+        record_late(pacer, now - pacer->deadline);
+        pacer->deadline = now + pacer->period;
+        return false;
+    }
+
+    const u64 remaining = pacer->deadline - now;
+    if(remaining > pacer->spin) {
+        const u64 freq = SDL_GetPerformanceFrequency();
+        const u32 sleep_ms = U32((remaining - pacer->spin) * 1000 / freq);
+        const u64 wake = now + sleep_ms * freq / 1000;
+        SDL_Delay(sleep_ms);
+        now = SDL_GetPerformanceCounter();
+        const u64 overshoot = now > wake ? now - wake : 0;
+        pacer->overshoot = SDL_max(overshoot, pacer->overshoot - pacer->overshoot / 16);
+        pacer->spin = SDL_min(SDL_max(pacer->base_spin, pacer->overshoot), pacer->max_spin);
+        if(now > pacer->deadline) {
+            pacer->overslept++;
+            record_late(pacer, now - pacer->deadline);
+        }
+    }
+    while(now < pacer->deadline)
+        now = SDL_GetPerformanceCounter();
+    pacer->deadline += pacer->period;
+    return true;
+}
+
+void frame_pacer_report(const DLE_FramePacer *pacer) {
+    if(!pacer->frames)
+        return;
+    const f64 ms_per_tick = 1000.0 / F64(SDL_GetPerformanceFrequency());
+    printf("frame pacer: %lu frames, %lu missed deadlines (%.2f%%), %lu oversleeps, worst %.3f ms late, spin %.3f ms\n",
+        (unsigned long)pacer->frames,
+        (unsigned long)pacer->missed,
+        100.0 * F64(pacer->missed) / F64(pacer->frames),
+        (unsigned long)pacer->overslept,
+        F64(pacer->worst_late) * ms_per_tick,
+        F64(pacer->spin) * ms_per_tick);
+}
@@ -0,0 +1,45 @@
+
+#ifndef lighting_example_pacer_H
+#define lighting_example_pacer_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+
+/* Frame pacing (TARGET_FPS).
+   Frames are due a fixed period apart. After a frame the pacer sleeps with
+   SDL_Delay until `spin` ticks before the next deadline, then spins on the
+   performance counter for the rest, so the wakeup is precise without busy
+   waiting through the whole frame. SDL_Delay wakes up late by a varying
+   amount, so the spin window is the larger of the configured spin and the
+   recent peak of that overshoot. The peak decays back by 1/16 per sleep
+   and the window never exceeds PACER_MAX_SPIN_FRACTION of a period, so a
+   single stall doesn't turn the pacer into a busy wait.
+   A frame that finishes after its deadline is a miss: the schedule restarts
+   from that frame instead of rushing out frames to catch up.
+*/
+
+#define PACER_DEFAULT_SPIN_US 500
+#define PACER_MAX_SPIN_FRACTION 0.25
+
+typedef struct {
+    u64 period;      // performance counter ticks per frame
+    u64 base_spin;   // configured spin, ticks
+    u64 max_spin;
+    u64 overshoot;   // decaying peak of how late SDL_Delay returned, ticks
+    u64 spin;        // ticks before the deadline that are spun instead of slept
+    u64 deadline;
+    bool started;
+    u64 frames;
+    u64 missed;      // deadlines the frame itself overran
+    u64 overslept;   // deadlines SDL_Delay slept through
+    u64 worst_late;  // ticks, over both
+} DLE_FramePacer;
+
+void frame_pacer_init(DLE_FramePacer *pacer, const f64 target_fps, const f64 spin_us);
+// Waits for the next deadline. Returns false if the deadline was missed.
+bool frame_pacer_wait(DLE_FramePacer *pacer);
+void frame_pacer_report(const DLE_FramePacer *pacer);
+
+#endif
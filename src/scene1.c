@@ -1,127 +1,70 @@
 
 #include "scene1.h"
+#include "commands.h"
+#include "textures.h"
 
 
 
 static SDL_Texture* brick_wall = NULL;
 static const int
-    brick_wall_w = 500,
-    brick_wall_h = 300;
-static bool create_brick_wall(void) {
-    // Return true if successful.
-    brick_wall = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        brick_wall_w,brick_wall_h);
-    if(!brick_wall) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetRenderTarget(r, brick_wall);
-    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
-
-    // Create a brick-like pattern (AI generated code).
-    for (int y = 0; y <brick_wall_h; y += 40) {
-        for (int x = 0; x < brick_wall_w; x += 60) {
-            // Alternate brick pattern
-            int offsetX = (y / 40) % 2 == 0 ? 0 : 30;
-            // Brick color
-            SDL_SetRenderDrawColor(r, 120 + (x + y) % 40, 80 + (x * y) % 30, 60, 255);
-            SDL_Rect brick = {x + offsetX, y, 55, 35};
-            SDL_RenderFillRect(r, &brick);
-            // Mortar lines
-            SDL_SetRenderDrawColor(r, 200, 200, 200, 255);
-            SDL_Rect mortarH = {x + offsetX - 2, y + 35, 59, 5};
-            SDL_Rect mortarV = {x + offsetX + 55, y, 5, 40};
-            SDL_RenderFillRect(r, &mortarH);
-            SDL_RenderFillRect(r, &mortarV);
-        }
-    }
-
-    reset_render_state();
-    return true;
-}
-
+    brick_wall_w = BRICK_WALL_WIDTH,
+    brick_wall_h = BRICK_WALL_HEIGHT;
 static SDL_Texture *light_mask = NULL;
-static bool create_light_mask(void) {
-    light_mask = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        WINDOW_WIDTH,WINDOW_HEIGHT);
-    if(!light_mask) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetTextureBlendMode(light_mask, SDL_BLENDMODE_BLEND);
-    return true;
-}
 
 bool scene_1_setup(void) {
-    if(!create_brick_wall())
+    brick_wall = texture_acquire(TEXTURE_KEY_BRICK_WALL, texture_create_brick_wall);
+    if(!brick_wall)
         return false;
-    if(!create_light_mask())
+    light_mask = texture_acquire(TEXTURE_KEY_MASK_TARGET, texture_create_mask_target);
+    if(!light_mask)
         return false;
     return true;
 }
 
 void scene_1_cleanup(void) {
-    free_texture_and_null(brick_wall);
-    free_texture_and_null(light_mask);
+    release_texture_and_null(brick_wall);
+    release_texture_and_null(light_mask);
 }
 
-void scene_1_draw(void) {
-    const u32 now = SDL_GetTicks();
-    SDL_SetRenderDrawColor(r, 0, 0, 0, 255);
-    SDL_RenderClear(r);
+void scene_1_draw(const DLE_FrameClock *clock) {
+    const u32 now = clock->now;
 
     /* Draw background*/
-    {
-        SDL_SetRenderDrawColor(r, 0, 127, 0, 255);
-        SDL_FRect dest = (SDL_FRect) {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
-        SDL_RenderFillRectF(r, &dest);
+    prof_zone("scene1_background") {
+        // opaque and covers the whole window, so it doubles as the clear
+        commands_fill(LAYER_BACKGROUND, NULL, SDL_BLENDMODE_NONE, NULL, (SDL_Color) {0, 127, 0, 255});
     }
 
     /* Draw actor */
-    {
+    prof_zone("scene1_wall") {
         const SDL_FRect dest = (SDL_FRect) {
             WINDOW_WIDTH*0.5 - brick_wall_w*0.5,
             WINDOW_HEIGHT*0.5 - brick_wall_h*0.5,
             brick_wall_w,
             brick_wall_h
         };
-        SDL_RenderCopyF(r, brick_wall, NULL, &dest);
+        commands_copy(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, brick_wall, &dest);
     }
 
     /* Build and draw light mask */
-    {
-        SDL_SetRenderTarget(r, light_mask);
-        SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
+    prof_zone("scene1_mask_build") {
         // add ambient darkness
-        SDL_SetRenderDrawColor(r, 0, 0, 0, 225);
-        SDL_FRect dest = (SDL_FRect) {
-            0, 0, WINDOW_WIDTH, WINDOW_HEIGHT,
-        };
-        SDL_RenderFillRectF(r, &dest);
+        commands_fill(LAYER_MASK, light_mask, SDL_BLENDMODE_NONE, NULL, (SDL_Color) {0, 0, 0, 225});
 
         // create light rays
-        dest = (SDL_FRect) {
+        const SDL_FRect dest = (SDL_FRect) {
             WINDOW_WIDTH*((now % 1000) / 1000.0), 0, 200, WINDOW_HEIGHT,
         };
-        SDL_SetRenderDrawColor(r, 0, 0, 0, 50);
-        SDL_RenderFillRectF(r, &dest);
+        commands_fill(LAYER_MASK, light_mask, SDL_BLENDMODE_NONE, &dest, (SDL_Color) {0, 0, 0, 50});
     }
 
     // apply light mask
-    reset_render_state();
-    const SDL_FRect dest = (SDL_FRect) {
-        0, 0, WINDOW_WIDTH, WINDOW_HEIGHT,
-    };
-    SDL_RenderCopyF(r, light_mask, NULL, &dest);
-
+    prof_zone("scene1_mask_composite") {
+        commands_copy(LAYER_COMPOSITE, NULL, SDL_BLENDMODE_BLEND, light_mask, NULL);
+    }
 
-    reset_render_state();
-    SDL_RenderPresent(r);
+    commands_flush();
+    prof_zone("scene1_present") {
+        SDL_RenderPresent(r);
+    }
 }
-
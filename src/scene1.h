@@ -9,7 +9,7 @@
 
 bool scene_1_setup(void);
 void scene_1_cleanup(void);
-void scene_1_draw(void);
+void scene_1_draw(const DLE_FrameClock *clock);
 
 
 #endif
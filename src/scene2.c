@@ -1,107 +1,122 @@
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "scene2.h"
+#include "commands.h"
+#include "lightshapes.h"
+#include "occluders.h"
+#include "scenefile.h"
+#include "textures.h"
 
 
 static SDL_Texture* brick_wall = NULL;
 static const int
-    brick_wall_w = 500,
-    brick_wall_h = 300;
-
-static bool create_brick_wall(void) {
-    // Return true if successful.
-    brick_wall = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        brick_wall_w,brick_wall_h);
-    if(!brick_wall) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetRenderTarget(r, brick_wall);
-    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
-
-    // Create a brick-like pattern (AI generated code).
-    for (int y = 0; y <brick_wall_h; y += 40) {
-        for (int x = 0; x < brick_wall_w; x += 60) {
-            // Alternate brick pattern
-            int offsetX = (y / 40) % 2 == 0 ? 0 : 30;
-            // Brick color
-            SDL_SetRenderDrawColor(r, 120 + (x + y) % 40, 80 + (x * y) % 30, 60, 255);
-            SDL_Rect brick = {x + offsetX, y, 55, 35};
-            SDL_RenderFillRect(r, &brick);
-            // Mortar lines
-            SDL_SetRenderDrawColor(r, 200, 200, 200, 255);
-            SDL_Rect mortarH = {x + offsetX - 2, y + 35, 59, 5};
-            SDL_Rect mortarV = {x + offsetX + 55, y, 5, 40};
-            SDL_RenderFillRect(r, &mortarH);
-            SDL_RenderFillRect(r, &mortarV);
-        }
-    }
-
-    reset_render_state();
-    return true;
-}
+    brick_wall_w = BRICK_WALL_WIDTH,
+    brick_wall_h = BRICK_WALL_HEIGHT;
 
 static SDL_Texture *light_mask = NULL;
-static bool create_light_mask(void) {
-    light_mask = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        WINDOW_WIDTH,WINDOW_HEIGHT);
-    if(!light_mask) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetTextureBlendMode(light_mask, SDL_BLENDMODE_BLEND);
-    return true;
-}
-
-static inline void load_verts(SDL_Vertex *verts, SDL_FPoint *points, SDL_Color center, SDL_Color edge) {
-    SDL_Color
-        blend_center_c = {255, 0, 0, 185},
-        edge_c = {0};
-    for(u32 i=0; i < 6; i++) {
-        verts[i] = (SDL_Vertex) {
-            points[i],
-            i == 0 ? center: edge,
-            (SDL_FPoint){0},
-        };
-    }
-}
+static const DLE_LightShape *light_ray_shape = NULL;
+
+/* Cone lights: the bulb's red and blue rays, followed by SCENE2_EXTRA_LIGHTS
+   spinning lights scattered over the screen for scaling tests. Each pass
+   over all lights is built into one buffer and drawn with one call.
+*/
+static DLE_ConeLight *cone_lights = NULL;
+static u32 cone_light_count = 0;
+static SDL_FPoint *cone_light_points = NULL;
+static DLE_Geometry color_pass = {0};
+static DLE_Geometry tint_pass = {0};
+static DLE_Geometry mask_pass = {0};
+
+// the wall blocks light, the mask is built from the cones clipped to what
+// each light can see
+static DLE_Occluders occluders = {0};
+static DLE_LightFans mask_fans = {0};
 
 bool scene_2_setup(void) {
-    if(!create_brick_wall()) {
-        fprintf(stderr, "create_brick_wall failed\n");
+    brick_wall = texture_acquire(TEXTURE_KEY_BRICK_WALL, texture_create_brick_wall);
+    if(!brick_wall)
+        return false;
+    light_mask = texture_acquire(TEXTURE_KEY_MASK_TARGET, texture_create_mask_target);
+    if(!light_mask)
+        return false;
+    // near edge half as wide as the far edge
+    light_ray_shape = light_shape_get(LIGHT_SHAPE_CONE, 2, 0.5f);
+    if(!light_ray_shape)
         return false;
+    {
+        const char *extra_lights_data = getenv("SCENE2_EXTRA_LIGHTS");
+        const int extra_lights = extra_lights_data ? atoi(extra_lights_data) : 0;
+        if(extra_lights < 0) {
+            fprintf(stderr, "SCENE2_EXTRA_LIGHTS env variable is invalid\n");
+            return false;
+        }
+        cone_light_count = 2 + U32(extra_lights);
     }
-    if(!create_light_mask()){
-        fprintf(stderr, "create_light_mask failed\n");
+    cone_lights = malloc(sizeof(DLE_ConeLight) * cone_light_count);
+    cone_light_points = malloc(sizeof(SDL_FPoint) * light_ray_shape->point_count * cone_light_count);
+    if(!cone_lights || !cone_light_points) {
+        fprintf(stderr, "failed to allocate %u cone lights\n", cone_light_count);
         return false;
     }
+    {
+        const SDL_FRect wall = {
+            WINDOW_WIDTH*0.5 - brick_wall_w*0.5,
+            WINDOW_HEIGHT*0.5 - brick_wall_h*0.5,
+            brick_wall_w,
+            brick_wall_h
+        };
+        occluders_clear(&occluders);
+        if(!occluders_add_rect(&occluders, &wall))
+            return false;
+        // plus the scene file's occluders, if any
+        const DLE_SceneFile *file = scene_file();
+        if(file && !occluders_add_segments(&occluders, file->segments, file->segment_count))
+            return false;
+    }
     return true;
 }
 
 void scene_2_cleanup(void) {
-    free_texture_and_null(brick_wall);
-    free_texture_and_null(light_mask);
+    release_texture_and_null(brick_wall);
+    release_texture_and_null(light_mask);
+    free_and_null(cone_lights);
+    free_and_null(cone_light_points);
+    cone_light_count = 0;
+    geometry_free(&color_pass);
+    geometry_free(&tint_pass);
+    geometry_free(&mask_pass);
+    occluders_free(&occluders);
+    light_fans_free(&mask_fans);
 }
 
+static void update_extra_lights(const u32 now) {
+    // deterministic positions and colors, every light spins at its own speed.
+    for(u32 i = 2; i < cone_light_count; i++) {
+        const u32 h = i * 2654435761u;
+        const u32 period = 800 + (h >> 4) % 2400;
+        cone_lights[i] = (DLE_ConeLight) {
+            .position = (SDL_FPoint) { F32(h % WINDOW_WIDTH), F32((h >> 12) % WINDOW_HEIGHT) },
+            .angle = 360 * F32((now + i * 97) % period) / period,
+            .length = 150 + (h >> 16) % 250,
+            .spread = 50 + (h >> 20) % 100,
+            .color = (SDL_Color) { U8(h >> 24), U8(h >> 16), U8(h >> 8), 255 },
+            .intensity = 0.5f,
+        };
+    }
+}
 
-void scene_2_draw(void) {
-    SDL_SetRenderDrawColor(r, 0, 0, 0, 255);
-    SDL_RenderClear(r);
 
+void scene_2_draw(const DLE_FrameClock *clock) {
     /* Draw background*/
-    {
-        SDL_SetRenderDrawColor(r, 0, 127, 0, 255);
-        SDL_FRect dest = (SDL_FRect) {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
-        SDL_RenderFillRectF(r, &dest);
+    prof_zone("scene2_background") {
+        // opaque and covers the whole window, so it doubles as the clear
+        commands_fill(LAYER_BACKGROUND, NULL, SDL_BLENDMODE_NONE, NULL, (SDL_Color) {0, 127, 0, 255});
     }
 
     /* Draw actors */
-    {
+    prof_zone("scene2_wall") {
         // draw wall
         const SDL_FRect dest = (SDL_FRect) {
             WINDOW_WIDTH*0.5 - brick_wall_w*0.5,
@@ -109,9 +124,9 @@ void scene_2_draw(void) {
             brick_wall_w,
             brick_wall_h
         };
-        SDL_RenderCopyF(r, brick_wall, NULL, &dest);
+        commands_copy(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, brick_wall, &dest);
     }
-    u32 now = SDL_GetTicks();
+    const u32 now = clock->now;
 
     const f32 bulb_side_len = 50;
     const f32
@@ -121,50 +136,33 @@ void scene_2_draw(void) {
     const f32 bc_x = bulb_x + bulb_side_len * 0.5;
     const f32 bc_y = bulb_y + bulb_side_len * 0.5;
     const f32
-        light_ray_w = 300,
-        light_ray_h = 1200;
-    const f32
-        light_ray_hw = light_ray_w * 0.5,
-        light_ray_hh = light_ray_h * 0.5;
-    const f32
-        light_ray_w_end = light_ray_w * 2;
-    const f32
-        light_ray_hw_end = light_ray_w_end * 0.5;
-
-    SDL_FPoint red_light_ray_points[] = {
-        {bc_x, bc_y},                                   // middle bottom
-        {bc_x - light_ray_hw, bc_y},                    // left bottom
-        {bc_x - light_ray_hw_end, bc_y - light_ray_hh}, // left top
-        {bc_x, bc_y - light_ray_hh},                    // middle top
-        {bc_x + light_ray_hw_end, bc_y - light_ray_hh}, // right top
-        {bc_x + light_ray_hw, bc_y},                    // right bottom
-    };
-
-    SDL_FPoint blue_light_ray_points[] = {
-        {bc_x, bc_y},                                   // middle bottom
-        {bc_x - light_ray_hw, bc_y},                    // left bottom
-        {bc_x - light_ray_hw_end, bc_y + light_ray_hh}, // left top
-        {bc_x, bc_y + light_ray_hh},                    // middle top
-        {bc_x + light_ray_hw_end, bc_y + light_ray_hh}, // right top
-        {bc_x + light_ray_hw, bc_y},                    // right bottom
-    };
+        light_ray_hw_end = 300,
+        light_ray_hh = 600;
 
+    // one transform per light, shared by the actor and mask passes
+    const SDL_FPoint bulb_center = {bc_x, bc_y};
     const f32 rotation = 360 * ((now % 800) / 800.0);
-    for(u32 i = 1; i < 6; i++) {
-        red_light_ray_points[i] = rotate_point(red_light_ray_points[0], red_light_ray_points[i], rotation);
-        blue_light_ray_points[i] = rotate_point(blue_light_ray_points[0], blue_light_ray_points[i], rotation);
-    }
-
-    int indicies[] = {
-        0, 1, 2,
-        0, 2, 3,
-        0, 3, 4,
-        0, 5, 4
+    const DLE_LightShape *shape = light_ray_shape;
+    cone_lights[0] = (DLE_ConeLight) {
+        .position = bulb_center,
+        .angle = rotation,
+        .length = light_ray_hh,
+        .spread = light_ray_hw_end,
+        .color = (SDL_Color) {255, 0, 0, 255},
+        .intensity = 185 / 255.0f,
     };
+    cone_lights[1] = (DLE_ConeLight) {
+        .position = bulb_center,
+        .angle = rotation + 180,
+        .length = light_ray_hh,
+        .spread = light_ray_hw_end,
+        .color = (SDL_Color) {0, 0, 160, 255},
+        .intensity = 185 / 255.0f,
+    };
+    update_extra_lights(now);
+    cone_lights_transform(shape, cone_lights, cone_light_count, cone_light_points);
 
-    const f32 rotation_degrees = 360 * ((now % 1000) / 1000.0);
-
-    {
+    prof_zone("scene2_light_actors") {
         /* Draw Lightbulb and actor-light-rays (ALR) */
         const SDL_FRect bulb_dest = (SDL_FRect) {
             bulb_x,
@@ -172,80 +170,48 @@ void scene_2_draw(void) {
             bulb_side_len,
             bulb_side_len
         };
-        SDL_SetRenderDrawColor(r, 255, 0, 0, 255);
-        SDL_RenderFillRectF(r, &bulb_dest);
-
-        // Red light
-        {
-            const SDL_Color
-                blend_center_c = {255, 0, 0, 185};
-            SDL_Vertex light_actor_blend_verts[6];
-            load_verts(light_actor_blend_verts, red_light_ray_points, blend_center_c, (SDL_Color) {0});
-            SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
-            SDL_RenderGeometry(r, NULL, light_actor_blend_verts, 6, indicies, 12);
-            SDL_Color
-                mul_center_c = {255, 127, 127, 0};
-            SDL_Vertex light_actor_mul_verts[6];
-            load_verts(light_actor_mul_verts, red_light_ray_points, mul_center_c, (SDL_Color) {0});
-            SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_MUL);
-            SDL_RenderGeometry(r, NULL, light_actor_mul_verts, 6, indicies, 12);
-        }
-
-        // blue light
-        {
-            const SDL_Color
-                blend_center_c = {0, 0, 160, 185};
-            SDL_Vertex light_actor_blend_verts[6];
-            load_verts(light_actor_blend_verts, blue_light_ray_points, blend_center_c, (SDL_Color) {0});
-            SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
-            SDL_RenderGeometry(r, NULL, light_actor_blend_verts, 6, indicies, 12);
-            SDL_Color
-                mul_center_c = {255, 127, 127, 0};
-            SDL_Vertex light_actor_mul_verts[6];
-            load_verts(light_actor_mul_verts, blue_light_ray_points, mul_center_c, (SDL_Color) {0});
-            SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_MUL);
-            SDL_RenderGeometry(r, NULL, light_actor_mul_verts, 6, indicies, 12);
-        }
-
+        commands_fill(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, &bulb_dest, (SDL_Color) {255, 0, 0, 255});
+
+        // every light's BLEND pass is drawn before the MUL passes
+        const SDL_Color tint_center_c = {255, 127, 127, 0};
+        geometry_clear(&color_pass);
+        geometry_clear(&tint_pass);
+        if(cone_lights_append(&color_pass, shape, cone_lights, cone_light_points, cone_light_count, NULL, (SDL_Color) {0}))
+            commands_geometry_ref(
+                LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND,
+                color_pass.verts, color_pass.vert_count, color_pass.indices, color_pass.index_count);
+        if(cone_lights_append(&tint_pass, shape, cone_lights, cone_light_points, cone_light_count, &tint_center_c, (SDL_Color) {0}))
+            commands_geometry_ref(
+                LAYER_ACTORS, NULL, SDL_BLENDMODE_MUL,
+                tint_pass.verts, tint_pass.vert_count, tint_pass.indices, tint_pass.index_count);
     }
 
     /* Build and draw light mask */
-    const u8 ambient_darkness_alpha = 235;
-    SDL_SetRenderTarget(r, light_mask);
-    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
-    // add ambient darkness
-    SDL_SetRenderDrawColor(r, 0, 0, 0, ambient_darkness_alpha);
-    SDL_FRect dest = (SDL_FRect) {
-        0, 0, WINDOW_WIDTH, WINDOW_HEIGHT,
-    };
-    SDL_RenderFillRectF(r, &dest);
-    { // red light
-        // create mask light rays
-        SDL_Color
-            center_c = {0, 0, 0, 0},
-            edge_c = {0, 0, 0, ambient_darkness_alpha};
-        SDL_Vertex light_mask_verts[6];
-        load_verts(light_mask_verts, red_light_ray_points, center_c, edge_c);
-        SDL_RenderGeometry(r, NULL, light_mask_verts, 6, indicies, 12);
-    }
-    { // blue light
-        SDL_Color
+    prof_zone("scene2_mask_build") {
+        const u8 ambient_darkness_alpha = 235;
+        // add ambient darkness
+        commands_fill(LAYER_MASK, light_mask, SDL_BLENDMODE_NONE, NULL, (SDL_Color) {0, 0, 0, ambient_darkness_alpha});
+        // mask light rays
+        const SDL_Color
             center_c = {0, 0, 0, 0},
             edge_c = {0, 0, 0, ambient_darkness_alpha};
-        SDL_Vertex light_mask_verts[6];
-        load_verts(light_mask_verts, blue_light_ray_points, center_c, edge_c);
-        SDL_RenderGeometry(r, NULL, light_mask_verts, 6, indicies, 12);
+        light_fans_clear(&mask_fans);
+        geometry_clear(&mask_pass);
+        if(occluders_clip_fans(&occluders, cone_light_points, shape->point_count, cone_light_count, &mask_fans)
+            && light_fans_append(&mask_pass, &mask_fans, center_c, edge_c))
+            commands_geometry_ref(
+                LAYER_MASK, light_mask, SDL_BLENDMODE_NONE,
+                mask_pass.verts, mask_pass.vert_count, mask_pass.indices, mask_pass.index_count);
     }
 
-
-
     // apply light mask
-    reset_render_state();
-    SDL_SetTextureBlendMode(light_mask, SDL_BLENDMODE_MUL);
-    SDL_RenderCopyF(r, light_mask, NULL, NULL);
-
+    prof_zone("scene2_mask_composite") {
+        commands_copy(LAYER_COMPOSITE, NULL, SDL_BLENDMODE_MUL, light_mask, NULL);
+    }
 
-    reset_render_state();
-    SDL_RenderPresent(r);
+    commands_flush();
+    prof_zone("scene2_present") {
+        SDL_RenderPresent(r);
+    }
 }
 
@@ -8,6 +8,6 @@
 
 bool scene_2_setup(void);
 void scene_2_cleanup(void);
-void scene_2_draw(void);
+void scene_2_draw(const DLE_FrameClock *clock);
 
 #endif
\ No newline at end of file
@@ -1,88 +1,86 @@
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "scene3.h"
+#include "commands.h"
+#include "lightshapes.h"
+#include "occluders.h"
+#include "scenefile.h"
+#include "textures.h"
 
 
 static SDL_Texture* brick_wall = NULL;
 static const int
-    brick_wall_w = 500,
-    brick_wall_h = 300;
+    brick_wall_w = BRICK_WALL_WIDTH,
+    brick_wall_h = BRICK_WALL_HEIGHT;
 
 
 static SDL_BlendMode light_mask_blend;
-
-static bool create_brick_wall(void) {
-    // Return true if successful.
-    brick_wall = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        brick_wall_w,brick_wall_h);
-    if(!brick_wall) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetRenderTarget(r, brick_wall);
-    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
-
-    // Create a brick-like pattern (AI generated code).
-    for (int y = 0; y <brick_wall_h; y += 40) {
-        for (int x = 0; x < brick_wall_w; x += 60) {
-            // Alternate brick pattern
-            int offsetX = (y / 40) % 2 == 0 ? 0 : 30;
-            // Brick color
-            SDL_SetRenderDrawColor(r, 120 + (x + y) % 40, 80 + (x * y) % 30, 60, 255);
-            SDL_Rect brick = {x + offsetX, y, 55, 35};
-            SDL_RenderFillRect(r, &brick);
-            // Mortar lines
-            SDL_SetRenderDrawColor(r, 200, 200, 200, 255);
-            SDL_Rect mortarH = {x + offsetX - 2, y + 35, 59, 5};
-            SDL_Rect mortarV = {x + offsetX + 55, y, 5, 40};
-            SDL_RenderFillRect(r, &mortarH);
-            SDL_RenderFillRect(r, &mortarV);
-        }
-    }
-
-    reset_render_state();
-    return true;
-}
+// overlapping cones keep the darkest mask alpha (light_mask_blend) where the
+// renderer supports it, otherwise the last cone drawn wins.
+static SDL_BlendMode mask_pass_blend = SDL_BLENDMODE_NONE;
 
 static SDL_Texture *light_mask = NULL;
-static SDL_Texture *light_mask_cookie_cutter = NULL;
-static bool create_light_mask(void) {
-    light_mask = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        WINDOW_WIDTH,WINDOW_HEIGHT);
-    if(!light_mask) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetTextureBlendMode(light_mask, SDL_BLENDMODE_BLEND);
-
-    light_mask_cookie_cutter = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        WINDOW_WIDTH,WINDOW_HEIGHT);
-    if(!light_mask_cookie_cutter) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetTextureBlendMode(light_mask_cookie_cutter, SDL_BLENDMODE_BLEND);
-    return true;
-}
-
+static const DLE_LightShape *light_ray_shape = NULL;
+
+/* Cone lights: the two swinging beams, followed by SCENE3_EXTRA_LIGHTS
+   swinging beams scattered over the screen for scaling tests. Each pass
+   over all lights is built into one buffer and drawn with one call.
+*/
+static DLE_ConeLight *cone_lights = NULL;
+static u32 cone_light_count = 0;
+static SDL_FPoint *cone_light_points = NULL;
+static DLE_Geometry color_pass = {0};
+static DLE_Geometry tint_pass = {0};
+static DLE_Geometry mask_pass = {0};
+
+// the wall blocks light, the mask is built from the cones clipped to what
+// each light can see
+static DLE_Occluders occluders = {0};
+static DLE_LightFans mask_fans = {0};
 
 bool scene_3_setup(void) {
-    if(!create_brick_wall()) {
-        fprintf(stderr, "create_brick_wall failed\n");
+    brick_wall = texture_acquire(TEXTURE_KEY_BRICK_WALL, texture_create_brick_wall);
+    if(!brick_wall)
         return false;
+    light_mask = texture_acquire(TEXTURE_KEY_MASK_TARGET, texture_create_mask_target);
+    if(!light_mask)
+        return false;
+    // straight beam, the near edge is as wide as the far edge
+    light_ray_shape = light_shape_get(LIGHT_SHAPE_CONE, 2, 1.0f);
+    if(!light_ray_shape)
+        return false;
+    {
+        const char *extra_lights_data = getenv("SCENE3_EXTRA_LIGHTS");
+        const int extra_lights = extra_lights_data ? atoi(extra_lights_data) : 0;
+        if(extra_lights < 0) {
+            fprintf(stderr, "SCENE3_EXTRA_LIGHTS env variable is invalid\n");
+            return false;
+        }
+        cone_light_count = 2 + U32(extra_lights);
     }
-    if(!create_light_mask()){
-        fprintf(stderr, "create_light_mask failed\n");
+    cone_lights = malloc(sizeof(DLE_ConeLight) * cone_light_count);
+    cone_light_points = malloc(sizeof(SDL_FPoint) * light_ray_shape->point_count * cone_light_count);
+    if(!cone_lights || !cone_light_points) {
+        fprintf(stderr, "failed to allocate %u cone lights\n", cone_light_count);
         return false;
     }
+    {
+        const SDL_FRect wall = {
+            WINDOW_WIDTH*0.5 - brick_wall_w*0.5,
+            WINDOW_HEIGHT*0.5 - brick_wall_h*0.5,
+            brick_wall_w,
+            brick_wall_h
+        };
+        occluders_clear(&occluders);
+        if(!occluders_add_rect(&occluders, &wall))
+            return false;
+        // plus the scene file's occluders, if any
+        const DLE_SceneFile *file = scene_file();
+        if(file && !occluders_add_segments(&occluders, file->segments, file->segment_count))
+            return false;
+    }
 
     light_mask_blend = SDL_ComposeCustomBlendMode(
     SDL_BLENDFACTOR_SRC_ALPHA,      // Source color factor
@@ -97,38 +95,48 @@ bool scene_3_setup(void) {
         fprintf(stderr, "blend mode is invalid\n");
         return false;
     }
+    mask_pass_blend = render_blend_supported(light_mask_blend) ? light_mask_blend : SDL_BLENDMODE_NONE;
 
     return true;
 }
 
 void scene_3_cleanup(void) {
-    free_texture_and_null(brick_wall);
-    free_texture_and_null(light_mask);
+    release_texture_and_null(brick_wall);
+    release_texture_and_null(light_mask);
+    free_and_null(cone_lights);
+    free_and_null(cone_light_points);
+    cone_light_count = 0;
+    geometry_free(&color_pass);
+    geometry_free(&tint_pass);
+    geometry_free(&mask_pass);
+    occluders_free(&occluders);
+    light_fans_free(&mask_fans);
 }
 
-static inline void load_verts(SDL_Vertex *verts, SDL_FPoint *points, SDL_Color center, SDL_Color edge) {
-    SDL_Color
-        blend_center_c = {255, 0, 0, 185},
-        edge_c = {0};
-    for(u32 i=0; i < 6; i++) {
-        verts[i] = (SDL_Vertex) {
-            points[i],
-            i == 0 ? center: edge,
-            (SDL_FPoint){0},
+static void update_extra_lights(const u32 now) {
+    // deterministic positions, every beam swings 45 degrees with its own phase.
+    for(u32 i = 2; i < cone_light_count; i++) {
+        const u32 h = i * 2654435761u;
+        const f32 nf = ((now + i * 97) % 1200) / 1200.0;
+        const f32 swing = nf < 0.5 ? nf * 2 : (1 - nf) * 2;
+        cone_lights[i] = (DLE_ConeLight) {
+            .position = (SDL_FPoint) { F32(h % WINDOW_WIDTH), F32((h >> 12) % WINDOW_HEIGHT) },
+            .angle = (i % 2 ? -45 : 45) * swing,
+            .length = 300 + (h >> 16) % 400,
+            .spread = 40 + (h >> 20) % 80,
+            .color = (SDL_Color) {255, 255, 255, 255},
+            .intensity = 100 / 255.0f,
         };
     }
 }
 
-void scene_3_draw(void) {
-    const u32 now = SDL_GetTicks();
-    SDL_SetRenderDrawColor(r, 0, 0, 0, 255);
-    SDL_RenderClear(r);
+void scene_3_draw(const DLE_FrameClock *clock) {
+    const u32 now = clock->now;
 
     /* Draw background*/
-    {
-        SDL_SetRenderDrawColor(r, 0, 127, 0, 255);
-        SDL_FRect dest = (SDL_FRect) {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
-        SDL_RenderFillRectF(r, &dest);
+    prof_zone("scene3_background") {
+        // opaque and covers the whole window, so it doubles as the clear
+        commands_fill(LAYER_BACKGROUND, NULL, SDL_BLENDMODE_NONE, NULL, (SDL_Color) {0, 127, 0, 255});
     }
 
     const f32 wall_x1 = WINDOW_WIDTH*0.5 - brick_wall_w*0.5;
@@ -147,30 +155,12 @@ void scene_3_draw(void) {
         ls_right_x = right_light_bulb_x1 + light_bulb_side_len * 0.5;
 
     const f32
-        light_ray_w = 300,
+        light_ray_hw = 150,
         light_ray_h = 900;
-    const f32
-        light_ray_hw = light_ray_w * 0.5,
-        light_ray_hh = light_ray_h * 0.5;
 
-    SDL_FPoint left_light_ray_points[] = {
-        {ls_left_x, ls_y},                               // middle bottom
-        {ls_left_x - light_ray_hw, ls_y},               // left bottom
-        {ls_left_x - light_ray_hw, ls_y - light_ray_h}, // left top
-        {ls_left_x, ls_y - light_ray_h},                // middle top
-        {ls_left_x + light_ray_hw, ls_y - light_ray_h}, // right top
-        {ls_left_x + light_ray_hw, ls_y},               // right bottom
-    };
-    SDL_FPoint right_light_ray_points[] = {
-        {ls_right_x, ls_y},                               // middle bottom
-        {ls_right_x - light_ray_hw, ls_y},               // left bottom
-        {ls_right_x - light_ray_hw, ls_y - light_ray_h}, // left top
-        {ls_right_x, ls_y - light_ray_h},                // middle top
-        {ls_right_x + light_ray_hw, ls_y - light_ray_h}, // right top
-        {ls_right_x + light_ray_hw, ls_y},               // right bottom
-    };
-
-    { // rotate points
+    // one transform per light, shared by the actor and mask passes
+    const DLE_LightShape *shape = light_ray_shape;
+    { // rotate lights
         // from 0 -> 1000: rotate_abs 0 -> 45
         // from 1000 -> 2000: rotate_abs 45 -> 0
         const f32 nf = (now % 1200) / 1200.0;
@@ -180,114 +170,96 @@ void scene_3_draw(void) {
         else
             offset_degrees_abs = 45 - 45 * ((nf - 0.5) * 2);
 
-        for(u32 i = 1; i < 6; i++) {
-            left_light_ray_points[i] = rotate_point(left_light_ray_points[0], left_light_ray_points[i], -offset_degrees_abs);
-            right_light_ray_points[i] = rotate_point(right_light_ray_points[0], right_light_ray_points[i], offset_degrees_abs);
-        }
+        cone_lights[0] = (DLE_ConeLight) {
+            .position = (SDL_FPoint) {ls_left_x, ls_y},
+            .angle = -offset_degrees_abs,
+            .length = light_ray_h,
+            .spread = light_ray_hw,
+            .color = (SDL_Color) {255, 255, 255, 255},
+            .intensity = 100 / 255.0f,
+        };
+        cone_lights[1] = (DLE_ConeLight) {
+            .position = (SDL_FPoint) {ls_right_x, ls_y},
+            .angle = offset_degrees_abs,
+            .length = light_ray_h,
+            .spread = light_ray_hw,
+            .color = (SDL_Color) {255, 255, 255, 255},
+            .intensity = 100 / 255.0f,
+        };
+        update_extra_lights(now);
+        cone_lights_transform(shape, cone_lights, cone_light_count, cone_light_points);
     }
 
-    const int indicies[] = {
-        0, 1, 2,
-        0, 2, 3,
-        0, 3, 4,
-        0, 5, 4
-    };
-
     /* Draw actors */
-    { // draw wall
+    prof_zone("scene3_wall") { // draw wall
         const SDL_FRect dest = (SDL_FRect) {
             wall_x1,
             wall_y2,
             brick_wall_w,
             brick_wall_h
         };
-        SDL_RenderCopyF(r, brick_wall, NULL, &dest);
+        commands_copy(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, brick_wall, &dest);
     }
-    { // light bulbs
-        SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
+    prof_zone("scene3_bulbs") { // light bulbs
+        const SDL_Color bulb_c = {255, 255, 255, 255};
         { // left bulb
             const SDL_FRect dest = (SDL_FRect) {
                 left_light_bulb_x1, light_bulbs_y2,
                 light_bulb_side_len, light_bulb_side_len
             };
-            SDL_RenderFillRectF(r, &dest);
+            commands_fill(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, &dest, bulb_c);
         }
         { // left bulb
             const SDL_FRect dest = (SDL_FRect) {
                 right_light_bulb_x1, light_bulbs_y2,
                 light_bulb_side_len, light_bulb_side_len
             };
-            SDL_RenderFillRectF(r, &dest);
+            commands_fill(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, &dest, bulb_c);
         }
     }
 
-    { // left light ray actors
-        const SDL_Color
-            blend_center_c = {255, 255, 255, 100};
-        SDL_Vertex light_actor_blend_verts[6];
-        load_verts(light_actor_blend_verts, left_light_ray_points, blend_center_c, (SDL_Color) {0});
-        SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
-        SDL_RenderGeometry(r, NULL, light_actor_blend_verts, 6, indicies, 12);
-        SDL_Color
-            mul_center_c = {255, 255, 255, 0};
-        SDL_Vertex light_actor_mul_verts[6];
-        load_verts(light_actor_mul_verts, left_light_ray_points, mul_center_c, (SDL_Color) {0});
-        SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_MUL);
-        SDL_RenderGeometry(r, NULL, light_actor_mul_verts, 6, indicies, 12);
-    }
-    { // right light ray actors
-        const SDL_Color
-            blend_center_c = {255, 255, 255, 100};
-        SDL_Vertex light_actor_blend_verts[6];
-        load_verts(light_actor_blend_verts, right_light_ray_points, blend_center_c, (SDL_Color) {0});
-        SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
-        SDL_RenderGeometry(r, NULL, light_actor_blend_verts, 6, indicies, 12);
-        SDL_Color
-            mul_center_c = {255, 255, 255, 0};
-        SDL_Vertex light_actor_mul_verts[6];
-        load_verts(light_actor_mul_verts, right_light_ray_points, mul_center_c, (SDL_Color) {0});
-        SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_MUL);
-        SDL_RenderGeometry(r, NULL, light_actor_mul_verts, 6, indicies, 12);
+    // every light's BLEND pass is drawn before the MUL passes
+    prof_zone("scene3_light_actors") {
+        const SDL_Color tint_center_c = {255, 255, 255, 0};
+        geometry_clear(&color_pass);
+        geometry_clear(&tint_pass);
+        if(cone_lights_append(&color_pass, shape, cone_lights, cone_light_points, cone_light_count, NULL, (SDL_Color) {0}))
+            commands_geometry_ref(
+                LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND,
+                color_pass.verts, color_pass.vert_count, color_pass.indices, color_pass.index_count);
+        if(cone_lights_append(&tint_pass, shape, cone_lights, cone_light_points, cone_light_count, &tint_center_c, (SDL_Color) {0}))
+            commands_geometry_ref(
+                LAYER_ACTORS, NULL, SDL_BLENDMODE_MUL,
+                tint_pass.verts, tint_pass.vert_count, tint_pass.indices, tint_pass.index_count);
     }
 
 
     /* Draw Light Mask */
-    {
+    prof_zone("scene3_mask_build") {
         const u8 ambient_darkness_alpha = 235;
-        { // add ambient darkness
-            SDL_SetRenderTarget(r, light_mask);
-            SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
-            SDL_SetRenderDrawColor(r, 0, 0, 0, ambient_darkness_alpha);
-            SDL_FRect dest = (SDL_FRect) {
-                0, 0, WINDOW_WIDTH, WINDOW_HEIGHT,
-            };
-            SDL_RenderFillRectF(r, &dest);
-        }
+        // add ambient darkness
+        commands_fill(LAYER_MASK, light_mask, SDL_BLENDMODE_NONE, NULL, (SDL_Color) {0, 0, 0, ambient_darkness_alpha});
 
-        SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
-        { // left light
-            SDL_Color
-                center_c = {0, 0, 0, 0},
-                edge_c = {0, 0, 0, ambient_darkness_alpha};
-            SDL_Vertex light_mask_verts[6];
-            load_verts(light_mask_verts, left_light_ray_points, center_c, edge_c);
-            SDL_RenderGeometry(r, NULL, light_mask_verts, 6, indicies, 12);
-        }
-        { // right light
-            SDL_Color
-                center_c = {0, 0, 0, 0},
-                edge_c = {0, 0, 0, ambient_darkness_alpha};
-            SDL_Vertex light_mask_verts[6];
-            load_verts(light_mask_verts, right_light_ray_points, center_c, edge_c);
-            SDL_RenderGeometry(r, NULL, light_mask_verts, 6, indicies, 12);
-        }
+        // mask light rays
+        const SDL_Color
+            center_c = {0, 0, 0, 0},
+            edge_c = {0, 0, 0, ambient_darkness_alpha};
+        light_fans_clear(&mask_fans);
+        geometry_clear(&mask_pass);
+        if(occluders_clip_fans(&occluders, cone_light_points, shape->point_count, cone_light_count, &mask_fans)
+            && light_fans_append(&mask_pass, &mask_fans, center_c, edge_c))
+            commands_geometry_ref(
+                LAYER_MASK, light_mask, mask_pass_blend,
+                mask_pass.verts, mask_pass.vert_count, mask_pass.indices, mask_pass.index_count);
+    }
 
-        // apply light mask to sceen
-        reset_render_state();
-        SDL_SetTextureBlendMode(light_mask, SDL_BLENDMODE_BLEND);
-        SDL_RenderCopyF(r, light_mask, NULL, NULL);
+    // apply light mask to sceen
+    prof_zone("scene3_mask_composite") {
+        commands_copy(LAYER_COMPOSITE, NULL, SDL_BLENDMODE_BLEND, light_mask, NULL);
     }
 
-    reset_render_state();
-    SDL_RenderPresent(r);
+    commands_flush();
+    prof_zone("scene3_present") {
+        SDL_RenderPresent(r);
+    }
 }
@@ -10,7 +10,7 @@
 
 bool scene_3_setup(void);
 void scene_3_cleanup(void);
-void scene_3_draw(void);
+void scene_3_draw(const DLE_FrameClock *clock);
 
 #endif
 
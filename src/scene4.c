@@ -1,93 +1,280 @@
 
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "commands.h"
+#include "lightshapes.h"
 #include "scene4.h"
+#include "scenefile.h"
+#include "textures.h"
+#include "workers.h"
 
 
 static SDL_Texture* brick_wall = NULL;
 static const int
-    brick_wall_w = 500,
-    brick_wall_h = 300;
+    brick_wall_w = BRICK_WALL_WIDTH,
+    brick_wall_h = BRICK_WALL_HEIGHT;
 
 
 static SDL_BlendMode light_mask_blend;
 
-const int indicies[] = {
-    0, 1, 2,
-    0, 2, 3,
-};
-
-static bool create_brick_wall(void) {
-    // Return true if successful.
-    brick_wall = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        brick_wall_w,brick_wall_h);
-    if(!brick_wall) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
+/* The light field is evaluated once per vertex of a lattice that covers the
+   viewport; mask cells read their four corners from it.
+*/
+#define LATTICE_GRID_LEN 64
+#define LATTICE_COLS ((WINDOW_WIDTH + LATTICE_GRID_LEN - 1) / LATTICE_GRID_LEN)
+#define LATTICE_ROWS ((WINDOW_HEIGHT + LATTICE_GRID_LEN - 1) / LATTICE_GRID_LEN)
+static const f32 lattice_grid_len = LATTICE_GRID_LEN;
+static const u32
+    lattice_cols = LATTICE_COLS,
+    lattice_rows = LATTICE_ROWS,
+    lattice_stride = LATTICE_COLS + 1;
+
+/* Light sources: the two bulbs, followed by SCENE4_EXTRA_LIGHTS small pulsing
+   lights scattered over the screen for scaling tests. Every frame the lights
+   are converted to SoA and binned into screen tiles.
+*/
+#define LIGHT_TILE_SIZE 128
+// ambient darkness applies outside of every light's radius. No light may be
+// darker than it, the falloff runs from min_alpha up to it.
+static const u8 ambient_darkness_alpha = 235;
+static DLE_LightSource *light_sources = NULL;
+static u32 light_source_count = 0;
+static DLE_LightSoA light_soa = {0};
+static DLE_LightBins light_bins = {0};
+// SCENE_FILE lights replace the generated ones. They are static, so they
+// are binned once in setup, straight from the mapped file.
+static const DLE_LightSoA *file_lights = NULL;
+
+/* Mask modes (SCENE4_MASK):
+     lattice   fixed LATTICE_GRID_LEN lattice (default)
+     adaptive  quadtree over ADAPTIVE_ROOT_LEN cells. A cell is split while
+               its corner alphas (or its center against the corners' mean)
+               differ by more than SCENE4_ADAPTIVE_THRESHOLD, or while it
+               contains a light's center, down to ADAPTIVE_MIN_LEN. Corners
+               that sit on a larger neighbour's edge take that edge's
+               interpolated alpha, so neighbours of different sizes meet
+               without T-junction seams.
+     pixels    exact per-pixel light field written by the CPU into a
+               streaming texture, no geometry at all.
+     accumulate  no light field evaluation: every light is its own ring mesh
+               drawn into the mask and the rasterizer combines overlapping
+               lights, so the CPU cost is per light vertex. With
+               light_mask_blend (MIN) where the renderer supports it,
+               otherwise as an additive light map composited with MOD. A
+               single light matches the other modes up to the ring
+               interpolation, overlaps take the darkest (MIN) or the summed
+               light (additive) instead of the product of the darkness.
+*/
+typedef enum {
+    MASK_MODE_LATTICE,
+    MASK_MODE_ADAPTIVE,
+    MASK_MODE_PIXELS,
+    MASK_MODE_ACCUMULATE,
+} DLE_MaskMode;
+static DLE_MaskMode mask_mode = MASK_MODE_LATTICE;
+
+#define ADAPTIVE_ROOT_LEN 128
+#define ADAPTIVE_MIN_LEN 8
+#define ADAPTIVE_DEFAULT_THRESHOLD 12
+#define ADAPTIVE_ROOT_COLS ((WINDOW_WIDTH + ADAPTIVE_ROOT_LEN - 1) / ADAPTIVE_ROOT_LEN)
+#define ADAPTIVE_ROOT_ROWS ((WINDOW_HEIGHT + ADAPTIVE_ROOT_LEN - 1) / ADAPTIVE_ROOT_LEN)
+// corners of every possible cell, on the ADAPTIVE_MIN_LEN grid
+#define ADAPTIVE_GRID_STRIDE (ADAPTIVE_ROOT_COLS * (ADAPTIVE_ROOT_LEN / ADAPTIVE_MIN_LEN) + 1)
+#define ADAPTIVE_GRID_ROWS (ADAPTIVE_ROOT_ROWS * (ADAPTIVE_ROOT_LEN / ADAPTIVE_MIN_LEN) + 1)
+_Static_assert(LIGHT_TILE_SIZE % ADAPTIVE_ROOT_LEN == 0, "adaptive cells must not straddle a light tile");
+_Static_assert((ADAPTIVE_ROOT_LEN / ADAPTIVE_MIN_LEN & (ADAPTIVE_ROOT_LEN / ADAPTIVE_MIN_LEN - 1)) == 0,
+    "adaptive cells must halve down to ADAPTIVE_MIN_LEN");
+static u8 adaptive_threshold = ADAPTIVE_DEFAULT_THRESHOLD;
+static u8 adaptive_roots[(ADAPTIVE_ROOT_COLS + 1) * (ADAPTIVE_ROOT_ROWS + 1)];
+static u8 adaptive_grid[ADAPTIVE_GRID_STRIDE * ADAPTIVE_GRID_ROWS];
+static DLE_Geometry adaptive_mesh = {0};
+
+#define ACCUMULATE_SEGMENTS 16
+#define ACCUMULATE_RINGS 4
+static const DLE_LightShape *accumulate_shape = NULL;
+static f32 accumulate_falloff[LIGHT_SHAPE_MAX_POINTS]; // easingSmoothEnd2 per shape point
+static bool accumulate_min = false;                    // light_mask_blend is supported
+static DLE_Geometry accumulate_mesh = {0};
+// file lights never change, their meshes are built on the first frame
+static bool accumulate_mesh_static = false;
+
+/* The whole mask is submitted with a single SDL_RenderGeometry call. Vertex
+   positions and indices are built once in setup, each frame only writes the
+   lattice alphas into the vertex colors. Uniform cells are ordinary quads in
+   the same buffer.
+*/
+static const u32
+    light_mask_vert_count = (LATTICE_COLS + 1) * (LATTICE_ROWS + 1),
+    light_mask_index_count = LATTICE_COLS * LATTICE_ROWS * 6;
+
+/* Incremental updates (lattice mode, on unless SCENE4_INCREMENTAL=0).
+   The mask texture persists between frames as long as no other scene draws
+   into the shared mask target in between. Only lattice vertices inside the
+   radius bounds of lights whose parameters changed since the previous frame
+   are re-evaluated, and only cells touching those vertices are redrawn, by
+   submitting the shared vertex buffer with an index list of the dirty cells.
+   Any discontinuity (first frame, skipped frames, scene switch, light count
+   or ambient change) falls back to a full rebuild.
+*/
+typedef u64 DLE_LatticeRowMask;
+_Static_assert(LATTICE_COLS + 1 <= 64, "lattice row must fit a u64 vertex mask");
+
+/* Lattice state: the vertex alphas, the mask mesh and what the next
+   incremental update compares against. The scene owns one, the self-test
+   drives its own.
+*/
+typedef struct {
+    u8 *alphas;
+    SDL_Vertex *verts;
+    int *indices;               // every cell
+    int *dirty_indices;         // cells with a dirty corner
+    u32 dirty_index_count;
+    DLE_LatticeRowMask dirty[LATTICE_ROWS + 1];
+    DLE_LightSource *prev_lights;
+    u32 light_count;
+    bool incremental;
+    bool valid;                 // the mask holds the lattice of frame_ix
+    u32 frame_ix;
+    u8 prev_ambient_alpha;
+} DLE_Lattice;
+static DLE_Lattice lattice = {0};
+
+static void lattice_free(DLE_Lattice *lattice) {
+    free_and_null(lattice->alphas);
+    free_and_null(lattice->verts);
+    free_and_null(lattice->indices);
+    free_and_null(lattice->dirty_indices);
+    free_and_null(lattice->prev_lights);
+    lattice->dirty_index_count = 0;
+    lattice->light_count = 0;
+    lattice->valid = false;
+}
+
+static bool lattice_init(DLE_Lattice *lattice, const u32 light_count, const bool incremental) {
+    // Returns false (and frees what it allocated) if an allocation failed.
+    *lattice = (DLE_Lattice){ .light_count = light_count, .incremental = incremental };
+    lattice->alphas = malloc(light_mask_vert_count);
+    lattice->verts = malloc(sizeof(SDL_Vertex) * light_mask_vert_count);
+    lattice->indices = malloc(sizeof(int) * light_mask_index_count);
+    lattice->dirty_indices = malloc(sizeof(int) * light_mask_index_count);
+    lattice->prev_lights = calloc(light_count ? light_count : 1, sizeof(DLE_LightSource));
+    if(!lattice->alphas || !lattice->verts || !lattice->indices || !lattice->dirty_indices || !lattice->prev_lights) {
+        fprintf(stderr, "%s failed to allocate the lattice\n", __func__);
+        lattice_free(lattice);
         return false;
     }
-    SDL_SetRenderTarget(r, brick_wall);
-    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
-
-    // Create a brick-like pattern (AI generated code).
-    for (int y = 0; y <brick_wall_h; y += 40) {
-        for (int x = 0; x < brick_wall_w; x += 60) {
-            // Alternate brick pattern
-            int offsetX = (y / 40) % 2 == 0 ? 0 : 30;
-            // Brick color
-            SDL_SetRenderDrawColor(r, 120 + (x + y) % 40, 80 + (x * y) % 30, 60, 255);
-            SDL_Rect brick = {x + offsetX, y, 55, 35};
-            SDL_RenderFillRect(r, &brick);
-            // Mortar lines
-            SDL_SetRenderDrawColor(r, 200, 200, 200, 255);
-            SDL_Rect mortarH = {x + offsetX - 2, y + 35, 59, 5};
-            SDL_Rect mortarV = {x + offsetX + 55, y, 5, 40};
-            SDL_RenderFillRect(r, &mortarH);
-            SDL_RenderFillRect(r, &mortarV);
+    for(u32 row = 0; row <= lattice_rows; row++) {
+        for(u32 col = 0; col <= lattice_cols; col++) {
+            lattice->verts[row * lattice_stride + col] = (SDL_Vertex) {
+                (SDL_FPoint){col * lattice_grid_len, row * lattice_grid_len},
+                (SDL_Color){0, 0, 0, 0},
+                (SDL_FPoint){0},
+            };
+        }
+    }
+    int *ix = lattice->indices;
+    for(u32 row = 0; row < lattice_rows; row++) {
+        for(u32 col = 0; col < lattice_cols; col++) {
+            const int
+                top_left = I32(row * lattice_stride + col),
+                top_right = top_left + 1,
+                bottom_left = top_left + I32(lattice_stride),
+                bottom_right = bottom_left + 1;
+            *ix++ = top_left; *ix++ = top_right; *ix++ = bottom_right;
+            *ix++ = top_left; *ix++ = bottom_right; *ix++ = bottom_left;
         }
     }
-
-    reset_render_state();
     return true;
 }
 
 static SDL_Texture *light_mask = NULL;
-static SDL_Texture *light_mask_cookie_cutter = NULL;
-static bool create_light_mask(void) {
-    light_mask = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        WINDOW_WIDTH,WINDOW_HEIGHT);
-    if(!light_mask) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetTextureBlendMode(light_mask, SDL_BLENDMODE_BLEND);
 
-    light_mask_cookie_cutter = SDL_CreateTexture(
-        r,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        WINDOW_WIDTH,WINDOW_HEIGHT);
-    if(!light_mask_cookie_cutter) {
-        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
-        return false;
-    }
-    SDL_SetTextureBlendMode(light_mask_cookie_cutter, SDL_BLENDMODE_BLEND);
-    return true;
-}
+static SDL_Texture *light_mask_pixels = NULL;
 
 
 bool scene_4_setup(void) {
-    if(!create_brick_wall()) {
-        fprintf(stderr, "create_brick_wall failed\n");
+    brick_wall = texture_acquire(TEXTURE_KEY_BRICK_WALL, texture_create_brick_wall);
+    if(!brick_wall)
         return false;
+    light_mask = texture_acquire(TEXTURE_KEY_MASK_TARGET, texture_create_mask_target);
+    if(!light_mask)
+        return false;
+
+    {
+        const char *extra_lights_data = getenv("SCENE4_EXTRA_LIGHTS");
+        const int extra_lights = extra_lights_data ? atoi(extra_lights_data) : 0;
+        if(extra_lights < 0) {
+            fprintf(stderr, "SCENE4_EXTRA_LIGHTS env variable is invalid\n");
+            return false;
+        }
+        light_source_count = 2 + U32(extra_lights);
     }
-    if(!create_light_mask()){
-        fprintf(stderr, "create_light_mask failed\n");
+    bool incremental = true;
+    {
+        const char *mask_mode_data = getenv("SCENE4_MASK");
+        if(!mask_mode_data || strcmp(mask_mode_data, "lattice") == 0)
+            mask_mode = MASK_MODE_LATTICE;
+        else if(strcmp(mask_mode_data, "adaptive") == 0)
+            mask_mode = MASK_MODE_ADAPTIVE;
+        else if(strcmp(mask_mode_data, "pixels") == 0)
+            mask_mode = MASK_MODE_PIXELS;
+        else if(strcmp(mask_mode_data, "accumulate") == 0)
+            mask_mode = MASK_MODE_ACCUMULATE;
+        else {
+            fprintf(stderr, "SCENE4_MASK env variable is invalid\n");
+            return false;
+        }
+        const char *incremental_data = getenv("SCENE4_INCREMENTAL");
+        incremental = !incremental_data || atoi(incremental_data) != 0;
+        const char *threshold_data = getenv("SCENE4_ADAPTIVE_THRESHOLD");
+        if(threshold_data) {
+            const int threshold_val = atoi(threshold_data);
+            if(threshold_val < 0 || threshold_val > 255) {
+                fprintf(stderr, "SCENE4_ADAPTIVE_THRESHOLD env variable is invalid\n");
+                return false;
+            }
+            adaptive_threshold = U8(threshold_val);
+        }
+    }
+    light_sources = calloc(light_source_count, sizeof(DLE_LightSource));
+    if(!light_sources) {
+        fprintf(stderr, "failed to allocate %u light sources\n", light_source_count);
+        return false;
+    }
+    if(!light_soa_reserve(&light_soa, light_source_count)) {
+        fprintf(stderr, "light_soa_reserve failed\n");
         return false;
     }
+    if(!light_bins_init(&light_bins, WINDOW_WIDTH, WINDOW_HEIGHT, LIGHT_TILE_SIZE)) {
+        fprintf(stderr, "light_bins_init failed\n");
+        return false;
+    }
+    {
+        const DLE_SceneFile *file = scene_file();
+        file_lights = file ? &file->lights : NULL;
+        for(u32 i = 0; file_lights && i < file_lights->count; i++) {
+            if(file_lights->min_alpha[i] > ambient_darkness_alpha) {
+                fprintf(stderr, "scene file light %u min_alpha %u exceeds the ambient alpha %u\n",
+                    i, file_lights->min_alpha[i], ambient_darkness_alpha);
+                return false;
+            }
+        }
+        if(file_lights && !light_bins_build(&light_bins, file_lights)) {
+            fprintf(stderr, "light_bins_build failed\n");
+            return false;
+        }
+    }
+    if(!lattice_init(&lattice, light_source_count, incremental)) {
+        fprintf(stderr, "lattice_init failed\n");
+        return false;
+    }
+    if(mask_mode == MASK_MODE_PIXELS) {
+        light_mask_pixels = texture_acquire(TEXTURE_KEY_MASK_PIXELS, texture_create_mask_pixels);
+        if(!light_mask_pixels)
+            return false;
+    }
 
     light_mask_blend = SDL_ComposeCustomBlendMode(
     SDL_BLENDFACTOR_SRC_ALPHA,      // Source color factor
@@ -102,13 +289,36 @@ bool scene_4_setup(void) {
         fprintf(stderr, "blend mode is invalid\n");
         return false;
     }
+    if(mask_mode == MASK_MODE_ACCUMULATE) {
+        accumulate_shape = light_shape_get(LIGHT_SHAPE_RINGS, ACCUMULATE_SEGMENTS, ACCUMULATE_RINGS);
+        if(!accumulate_shape)
+            return false;
+        // by ring, so the outer ring is exactly at the edge
+        accumulate_falloff[0] = 0;
+        for(u32 i = 1; i < accumulate_shape->point_count; i++) {
+            const f32 ndist = pow2(F32((i - 1) / ACCUMULATE_SEGMENTS + 1) / ACCUMULATE_RINGS);
+            accumulate_falloff[i] = easingSmoothEnd2(ndist);
+        }
+        accumulate_min = render_blend_supported(light_mask_blend);
+    }
 
     return true;
 }
 
 void scene_4_cleanup(void) {
-    free_texture_and_null(brick_wall);
-    free_texture_and_null(light_mask);
+    release_texture_and_null(brick_wall);
+    release_texture_and_null(light_mask);
+    release_texture_and_null(light_mask_pixels);
+    lattice_free(&lattice);
+    free_and_null(light_sources);
+    light_source_count = 0;
+    light_soa_free(&light_soa);
+    light_bins_free(&light_bins);
+    file_lights = NULL;
+    geometry_free(&adaptive_mesh);
+    geometry_free(&accumulate_mesh);
+    accumulate_mesh_static = false;
+    accumulate_shape = NULL;
 }
 
 static inline void load_verts(SDL_Vertex *verts, SDL_FPoint *points, SDL_Color center, SDL_Color edge) {
@@ -124,70 +334,357 @@ static inline void load_verts(SDL_Vertex *verts, SDL_FPoint *points, SDL_Color c
     }
 }
 
-static inline u8 combine_alphas_multiplicative(const u8 alphas[], int count) {
-    double combined_darkness = 1.0;
-    for (int i = 0; i < count; i++) {
-        double darkness = alphas[i] / 255.0;
-        combined_darkness *= darkness;
+typedef struct {
+    DLE_Lattice *lattice;
+    const DLE_LightBins *bins;
+    u8 ambient_alpha;
+} DLE_LatticeJob;
+
+static void eval_lattice_rows(void *ctx, const u32 begin, const u32 end) {
+    // worker job: evaluates the dirty vertices of lattice rows [begin, end)
+    // straight into the mask vertices.
+    const DLE_LatticeJob *job = ctx;
+    DLE_Lattice *lattice = job->lattice;
+    prof_zone("scene4_lattice_rows") {
+        for(u32 row = begin; row < end; row++) {
+            u8 *lattice_row = &lattice->alphas[row * lattice_stride];
+            SDL_Vertex *verts = &lattice->verts[row * lattice_stride];
+            const DLE_LatticeRowMask dirty = lattice->dirty[row];
+            u32 col = 0;
+            while(col < lattice_stride) {
+                // runs of dirty vertices
+                if(!(dirty >> col & 1)) {
+                    col++;
+                    continue;
+                }
+                u32 run_end = col + 1;
+                while(run_end < lattice_stride && (dirty >> run_end & 1))
+                    run_end++;
+                light_bins_eval_row(
+                    job->bins,
+                    col * lattice_grid_len, lattice_grid_len, row * lattice_grid_len,
+                    run_end - col,
+                    job->ambient_alpha,
+                    lattice_row + col);
+                for(; col < run_end; col++)
+                    verts[col].color.a = lattice_row[col];
+            }
+        }
+    }
+}
+
+typedef struct {
+    u8 *pixels;
+    int pitch;
+    u8 ambient_alpha;
+} DLE_MaskPixelsJob;
+
+static void eval_mask_pixel_rows(void *ctx, const u32 begin, const u32 end) {
+    // worker job: evaluates the light field at every mask pixel center of
+    // rows [begin, end). RGBA8888 is packed, so black with alpha a is just a.
+    const DLE_MaskPixelsJob *job = ctx;
+    const u32 width = mask_width();
+    const f32 texel_len = mask_scale;
+    u8 alphas[WINDOW_WIDTH];
+    prof_zone("scene4_pixel_rows") {
+        for(u32 row = begin; row < end; row++) {
+            light_bins_eval_row(
+                &light_bins,
+                texel_len * 0.5f, texel_len, (row + 0.5f) * texel_len,
+                width,
+                job->ambient_alpha,
+                alphas);
+            u32 *dst = (u32*)(job->pixels + row * job->pitch);
+            for(u32 x = 0; x < width; x++)
+                dst[x] = alphas[x];
+        }
     }
-    return U8(combined_darkness * 255.0);
 }
 
-static inline u8 get_ambient_light_at_position(
-    const f32 x,
-    const f32 y,
-    const u8 ambient_alpha,
-    const DLE_LightSource *lights,
-    const u32 lights_count
+static inline bool light_source_equal(const DLE_LightSource *a, const DLE_LightSource *b) {
+    return a->min_alpha == b->min_alpha
+        && !(a->position.x < b->position.x || a->position.x > b->position.x)
+        && !(a->position.y < b->position.y || a->position.y > b->position.y)
+        && !(a->radius_squared < b->radius_squared || a->radius_squared > b->radius_squared);
+}
+
+static void mark_light_dirty(DLE_Lattice *lattice, const DLE_LightSource *light) {
+    // every lattice vertex within the light's radius bounds.
+    const f32 radius = sqrtf(light->radius_squared);
+    const f32
+        x1 = (light->position.x - radius) / lattice_grid_len,
+        x2 = (light->position.x + radius) / lattice_grid_len,
+        y1 = (light->position.y - radius) / lattice_grid_len,
+        y2 = (light->position.y + radius) / lattice_grid_len;
+    if(x2 < 0 || y2 < 0 || x1 > lattice_cols || y1 > lattice_rows)
+        return;
+    const u32
+        col1 = x1 <= 0 ? 0 : U32(ceilf(x1)),
+        col2 = x2 >= lattice_cols ? lattice_cols : U32(x2),
+        row1 = y1 <= 0 ? 0 : U32(ceilf(y1)),
+        row2 = y2 >= lattice_rows ? lattice_rows : U32(y2);
+    if(col1 > col2)
+        return;
+    const DLE_LatticeRowMask cols_mask = ((~(DLE_LatticeRowMask)0) >> (63 - (col2 - col1))) << col1;
+    for(u32 row = row1; row <= row2; row++)
+        lattice->dirty[row] |= cols_mask;
+}
+
+static bool mark_lattice_dirty(
+    DLE_Lattice *lattice, const DLE_LightSource *lights,
+    const DLE_FrameClock *clock, const u8 ambient_alpha
 ) {
-    /* caller guarantees that ambient_alpha >= all light sources' min_alpha
-    */
-    if(lights_count == 0)
-        return ambient_alpha;
-
-    #define MAX_SAMPLES 32
-    u8 samples[MAX_SAMPLES];
-    u32 samples_count = 0;
-    f32 min_a;
-    u32 count = 0;
-    for(u32 i = 0; i < lights_count; i++) {
-        const f32 ds = dist_sq(x, y, lights[i].position.x, lights[i].position.y);
-        if(ds > lights[i].radius_squared)
+    // Returns true if the whole lattice has to be rebuilt.
+    const bool full = !lattice->incremental
+        || !lattice->valid
+        || clock->frame_ix != lattice->frame_ix + 1
+        || ambient_alpha != lattice->prev_ambient_alpha;
+    const DLE_LatticeRowMask all_cols = (~(DLE_LatticeRowMask)0) >> (64 - lattice_stride);
+    for(u32 row = 0; row <= lattice_rows; row++)
+        lattice->dirty[row] = full ? all_cols : 0;
+    if(!full) {
+        for(u32 i = 0; i < lattice->light_count; i++) {
+            if(light_source_equal(&lights[i], &lattice->prev_lights[i]))
+                continue;
+            mark_light_dirty(lattice, &lattice->prev_lights[i]);
+            mark_light_dirty(lattice, &lights[i]);
+        }
+    }
+
+    memcpy(lattice->prev_lights, lights, sizeof(DLE_LightSource) * lattice->light_count);
+    lattice->prev_ambient_alpha = ambient_alpha;
+    lattice->frame_ix = clock->frame_ix;
+    lattice->valid = true;
+    return full;
+}
+
+static void build_dirty_cell_indices(DLE_Lattice *lattice) {
+    // cells with at least one dirty corner.
+    int *ix = lattice->dirty_indices;
+    const DLE_LatticeRowMask cell_cols = (~(DLE_LatticeRowMask)0) >> (64 - lattice_cols);
+    for(u32 row = 0; row < lattice_rows; row++) {
+        const DLE_LatticeRowMask corners = lattice->dirty[row] | lattice->dirty[row + 1];
+        const DLE_LatticeRowMask cells = (corners | corners >> 1) & cell_cols;
+        if(!cells)
             continue;
+        for(u32 col = 0; col < lattice_cols; col++) {
+            if(!(cells >> col & 1))
+                continue;
+            const int *cell = &lattice->indices[(row * lattice_cols + col) * 6];
+            for(u32 i = 0; i < 6; i++)
+                *ix++ = cell[i];
+        }
+    }
+    lattice->dirty_index_count = U32(ix - lattice->dirty_indices);
+}
+
+static const int *update_lattice(
+    DLE_Lattice *lattice, const DLE_LightBins *bins, const DLE_LightSource *lights,
+    const DLE_FrameClock *clock, const u8 ambient_alpha, u32 *index_count
+) {
+    // Returns the index list of the cells the mask has to redraw: every cell
+    // after a full rebuild, otherwise the cells with a dirty corner.
+    const bool full = mark_lattice_dirty(lattice, lights, clock, ambient_alpha);
+    DLE_LatticeJob job = { .lattice = lattice, .bins = bins, .ambient_alpha = ambient_alpha };
+    workers_parallel_for(lattice_rows + 1, 1, eval_lattice_rows, &job);
+    if(full) {
+        *index_count = light_mask_index_count;
+        return lattice->indices;
+    }
+    build_dirty_cell_indices(lattice);
+    *index_count = lattice->dirty_index_count;
+    return lattice->dirty_indices;
+}
 
-        // 0 = brightest, 1 = ambient darkness
-        const f32 ndist = (ds) / (lights[i].radius_squared);
-        const f32 perc_from_edge =  easingSmoothEnd2(ndist);
-        const f32 alpha_range = (ambient_alpha - lights[i].min_alpha);
-        const u8 ls_a = lights[i].min_alpha + U8(alpha_range * perc_from_edge);
+static inline u8 sample_light(const f32 x, const f32 y, const u8 ambient_alpha) {
+    u8 a;
+    light_bins_eval_row(&light_bins, x, 0, y, 1, ambient_alpha, &a);
+    return a;
+}
 
-        if(samples_count < MAX_SAMPLES)
-            samples[samples_count++] = ls_a;
-        else {
-            samples[0] = ls_a;
+static bool cell_contains_light(const f32 x, const f32 y, const f32 len) {
+    // adaptive cells never straddle a light tile, every candidate is in this tile.
+    const DLE_LightSoA lights = light_bins_tile(&light_bins, x, y);
+    for(u32 i = 0; i < lights.count; i++) {
+        if(lights.x[i] >= x && lights.x[i] < x + len && lights.y[i] >= y && lights.y[i] < y + len)
+            return true;
+    }
+    return false;
+}
+
+static void emit_adaptive_cell(
+    const f32 x, const f32 y, const f32 len,
+    const u8 a0, const u8 a1, const u8 a2, const u8 a3, // top left, top right, bottom right, bottom left
+    const u8 ambient_alpha
+) {
+    bool split = false;
+    u8 center = 0;
+    if(len > ADAPTIVE_MIN_LEN) {
+        const u8
+            lo = SDL_min(SDL_min(a0, a1), SDL_min(a2, a3)),
+            hi = SDL_max(SDL_max(a0, a1), SDL_max(a2, a3));
+        center = sample_light(x + len * 0.5f, y + len * 0.5f, ambient_alpha);
+        const int mean = (a0 + a1 + a2 + a3) / 4;
+        split = hi - lo > adaptive_threshold
+            || abs(center - mean) > adaptive_threshold
+            || cell_contains_light(x, y, len);
+    }
+    if(!split) {
+        if(!geometry_reserve(&adaptive_mesh, 4, 6))
+            return;
+        geometry_push_quad(
+            &adaptive_mesh,
+            (SDL_FPoint){x, y}, (SDL_FPoint){x + len, y},
+            (SDL_FPoint){x + len, y + len}, (SDL_FPoint){x, y + len},
+            (SDL_Color){0, 0, 0, a0}, (SDL_Color){0, 0, 0, a1},
+            (SDL_Color){0, 0, 0, a2}, (SDL_Color){0, 0, 0, a3});
+        return;
+    }
+    const f32 h = len * 0.5f;
+    const u8
+        top = sample_light(x + h, y, ambient_alpha),
+        right = sample_light(x + len, y + h, ambient_alpha),
+        bottom = sample_light(x + h, y + len, ambient_alpha),
+        left = sample_light(x, y + h, ambient_alpha);
+    emit_adaptive_cell(x, y, h, a0, top, center, left, ambient_alpha);
+    emit_adaptive_cell(x + h, y, h, top, a1, right, center, ambient_alpha);
+    emit_adaptive_cell(x + h, y + h, h, center, right, a2, bottom, ambient_alpha);
+    emit_adaptive_cell(x, y + h, h, left, center, bottom, a3, ambient_alpha);
+}
+
+static inline u8 *adaptive_corner(const SDL_Vertex *vert) {
+    return &adaptive_grid[
+        U32(vert->position.y) / ADAPTIVE_MIN_LEN * ADAPTIVE_GRID_STRIDE + U32(vert->position.x) / ADAPTIVE_MIN_LEN];
+}
+
+static void snap_adaptive_edges(void) {
+    /* Every corner on the inside of a larger cell's edge takes the alpha the
+       larger cell interpolates there. Larger cells go first: their own
+       corners can only sit on even larger cells' edges, so they are final.
+    */
+    SDL_Vertex *verts = adaptive_mesh.verts;
+    const u32 quad_count = adaptive_mesh.vert_count / 4;
+    for(u32 i = 0; i < quad_count * 4; i++)
+        *adaptive_corner(&verts[i]) = verts[i].color.a;
+    for(u32 len = ADAPTIVE_ROOT_LEN; len > ADAPTIVE_MIN_LEN; len /= 2) {
+        const u32 steps = len / ADAPTIVE_MIN_LEN;
+        for(u32 quad = 0; quad < quad_count; quad++) {
+            const SDL_Vertex *q = &verts[quad * 4];
+            if(U32(q[1].position.x - q[0].position.x) != len)
+                continue;
+            // top, right, bottom, left: the corners at either end, grid step along the edge
+            const struct { u32 from, to; i32 step; } edges[4] = {
+                {0, 1, 1}, {1, 2, ADAPTIVE_GRID_STRIDE}, {3, 2, 1}, {0, 3, ADAPTIVE_GRID_STRIDE},
+            };
+            for(u32 e = 0; e < 4; e++) {
+                u8 *corner = adaptive_corner(&q[edges[e].from]);
+                const u32 a0 = *corner, a1 = *adaptive_corner(&q[edges[e].to]);
+                for(u32 k = 1; k < steps; k++)
+                    corner[I32(k) * edges[e].step] = U8((a0 * (steps - k) + a1 * k + steps / 2) / steps);
+            }
+        }
+    }
+    for(u32 i = 0; i < quad_count * 4; i++)
+        verts[i].color.a = *adaptive_corner(&verts[i]);
+}
+
+static void build_adaptive_mesh(const u8 ambient_alpha) {
+    const u32 stride = ADAPTIVE_ROOT_COLS + 1;
+    for(u32 row = 0; row <= ADAPTIVE_ROOT_ROWS; row++) {
+        light_bins_eval_row(
+            &light_bins,
+            0, ADAPTIVE_ROOT_LEN, F32(row * ADAPTIVE_ROOT_LEN),
+            stride,
+            ambient_alpha,
+            &adaptive_roots[row * stride]);
+    }
+    geometry_clear(&adaptive_mesh);
+    for(u32 row = 0; row < ADAPTIVE_ROOT_ROWS; row++) {
+        const u8 *top = &adaptive_roots[row * stride], *bottom = top + stride;
+        for(u32 col = 0; col < ADAPTIVE_ROOT_COLS; col++) {
+            emit_adaptive_cell(
+                F32(col * ADAPTIVE_ROOT_LEN), F32(row * ADAPTIVE_ROOT_LEN), ADAPTIVE_ROOT_LEN,
+                top[col], top[col + 1], bottom[col + 1], bottom[col],
+                ambient_alpha);
         }
+    }
+    snap_adaptive_edges();
+}
 
-        if(!(count++))
-            min_a = ls_a;
-        else
-            min_a = ls_a < min_a ? ls_a : min_a;
+typedef struct {
+    const DLE_LightSoA *lights;
+    u8 ambient_alpha;
+} DLE_AccumulateJob;
+
+static void build_accumulate_lights(void *ctx, const u32 begin, const u32 end) {
+    // worker job: the ring meshes of lights [begin, end). Every light has a
+    // fixed slot in the mesh. MIN takes the light's alpha, the light map the
+    // light it adds over the ambient darkness.
+    const DLE_AccumulateJob *job = ctx;
+    const DLE_LightSoA *lights = job->lights;
+    const DLE_LightShape *shape = accumulate_shape;
+    prof_zone("scene4_accumulate_lights") {
+        for(u32 i = begin; i < end; i++) {
+            const f32
+                x = lights->x[i],
+                y = lights->y[i],
+                radius = sqrtf(lights->radius_squared[i]),
+                alpha_range = F32(job->ambient_alpha - lights->min_alpha[i]);
+            const int base = I32(i * shape->point_count);
+            SDL_Vertex *verts = &accumulate_mesh.verts[base];
+            for(u32 j = 0; j < shape->point_count; j++) {
+                const u8
+                    a = lights->min_alpha[i] + U8(alpha_range * accumulate_falloff[j]),
+                    light = job->ambient_alpha - a;
+                verts[j] = (SDL_Vertex) {
+                    (SDL_FPoint){x + shape->points[j].x * radius, y + shape->points[j].y * radius},
+                    accumulate_min ? (SDL_Color){0, 0, 0, a} : (SDL_Color){light, light, light, 255},
+                    (SDL_FPoint){0},
+                };
+            }
+            int *indices = &accumulate_mesh.indices[i * shape->index_count];
+            for(u32 j = 0; j < shape->index_count; j++)
+                indices[j] = base + shape->indices[j];
+        }
     }
-    if(!count) return ambient_alpha;
-    if(count == 1) return min_a;
-    return combine_alphas_multiplicative(samples, samples_count);
+}
+
+static void build_accumulate_mesh(const DLE_LightSoA *lights, const u8 ambient_alpha) {
+    const DLE_LightShape *shape = accumulate_shape;
+    geometry_clear(&accumulate_mesh);
+    if(!geometry_reserve(&accumulate_mesh, shape->point_count * lights->count, shape->index_count * lights->count))
+        return;
+    DLE_AccumulateJob job = { .lights = lights, .ambient_alpha = ambient_alpha };
+    workers_parallel_for(lights->count, 256, build_accumulate_lights, &job);
+    accumulate_mesh.vert_count = shape->point_count * lights->count;
+    accumulate_mesh.index_count = shape->index_count * lights->count;
+}
 
+static void update_extra_lights(
+    DLE_LightSource *lights, const u32 count,
+    const u32 now, const u8 amin, const u8 amax
+) {
+    // deterministic positions, every light pulses with its own phase.
+    for(u32 i = 2; i < count; i++) {
+        const u32 h = i * 2654435761u;
+        const f32 radius = 60 + (h >> 8) % 100;
+        const f32 cycle_nf = ((now + i * 97) % 1500) / 1500.0;
+        const f32 pulse = cycle_nf < 0.5 ? cycle_nf * 2 : (1 - cycle_nf) * 2;
+        lights[i] = (DLE_LightSource) {
+            .position=(SDL_FPoint){ F32(h % WINDOW_WIDTH), F32((h >> 12) % WINDOW_HEIGHT) },
+            .radius_squared=pow2(radius),
+            .min_alpha = amin + U8((amax - amin) * pulse),
+        };
+    }
 }
 
-void scene_4_draw(void) {
-    const u32 now = SDL_GetTicks();
-    SDL_SetRenderDrawColor(r, 0, 0, 0, 255);
-    SDL_RenderClear(r);
+void scene_4_draw(const DLE_FrameClock *clock) {
+    const u32 now = clock->now;
 
     /* Draw background*/
-    {
-        SDL_SetRenderDrawColor(r, 0, 127, 0, 255);
-        SDL_FRect dest = (SDL_FRect) {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
-        SDL_RenderFillRectF(r, &dest);
+    prof_zone("scene4_background") {
+        // opaque and covers the whole window, so it doubles as the clear
+        commands_fill(LAYER_BACKGROUND, NULL, SDL_BLENDMODE_NONE, NULL, (SDL_Color) {0, 127, 0, 255});
     }
 
     const f32 wall_x1 = WINDOW_WIDTH*0.5 - brick_wall_w*0.5;
@@ -223,125 +720,247 @@ void scene_4_draw(void) {
         lmina = amin + (arange*pss);
     }
 
-    const DLE_LightSource light_sources[] = {
-        (DLE_LightSource) {
+    if(!file_lights) {
+        light_sources[0] = (DLE_LightSource) {
             .position=(SDL_FPoint){ ls_left_x, ls_y },
             .radius_squared=pow2(500),
             .min_alpha = lmina,
-        },
-        (DLE_LightSource) {
+        };
+        light_sources[1] = (DLE_LightSource) {
             .position=(SDL_FPoint){ ls_right_x, ls_y },
             .radius_squared=pow2(400),
             .min_alpha = rmina,
-        },
-    };
+        };
+        update_extra_lights(light_sources, light_source_count, now, amin, amax);
+    }
 
 
     /* Draw actors */
-    { // draw wall
+    prof_zone("scene4_wall") { // draw wall
         const SDL_FRect dest = (SDL_FRect) {
             wall_x1,
             wall_y2,
             brick_wall_w,
             brick_wall_h
         };
-        SDL_RenderCopyF(r, brick_wall, NULL, &dest);
+        commands_copy(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, brick_wall, &dest);
     }
-    { // light bulbs
-        SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
+    prof_zone("scene4_bulbs") { // light bulbs
+        const SDL_Color bulb_c = {255, 255, 255, 255};
         { // left bulb
             const SDL_FRect dest = (SDL_FRect) {
                 left_light_bulb_x1, light_bulbs_y2,
                 light_bulb_side_len, light_bulb_side_len
             };
-            SDL_RenderFillRectF(r, &dest);
+            commands_fill(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, &dest, bulb_c);
         }
         { // left bulb
             const SDL_FRect dest = (SDL_FRect) {
                 right_light_bulb_x1, light_bulbs_y2,
                 light_bulb_side_len, light_bulb_side_len
             };
-            SDL_RenderFillRectF(r, &dest);
+            commands_fill(LAYER_ACTORS, NULL, SDL_BLENDMODE_BLEND, &dest, bulb_c);
         }
     }
 
     // light mask
-    // add ambient darkness
-    const u8 ambient_darkness_alpha = 235;
-    SDL_SetRenderTarget(r, light_mask);
-    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
-    SDL_SetRenderDrawColor(r, 0, 0, 0, ambient_darkness_alpha);
-    {
-        const SDL_FRect dest = (SDL_FRect) {
-            0, 0, WINDOW_WIDTH, WINDOW_HEIGHT,
-        };
-        SDL_RenderFillRectF(r, &dest);
-    }
-    // add light to mask
-    u32 rects_written = 0;
-    const f32 grid_len = 64;
-    for(f32 x=0; x < WINDOW_WIDTH; x += grid_len) {
-        for(f32 y=0; y < WINDOW_WIDTH; y += grid_len) {
-
-            { // method a
-                // const u8 a = get_ambient_light_at_position(
-                //     x,
-                //     y,
-                //     ambient_darkness_alpha,
-                //     light_sources,
-                //     2);
-                // const SDL_FRect rect = (SDL_FRect) {x, y, grid_len, grid_len};
-                // SDL_SetRenderDrawColor(r, 0, 0, 0, a);
-                // SDL_RenderFillRectF(r, &rect);
-            }
-            { //method b
-                const u8 a0 = get_ambient_light_at_position( // top left
-                    x,
-                    y,
-                    ambient_darkness_alpha,
-                    light_sources,
-                    2);
-                const u8 a1 = get_ambient_light_at_position( // top right
-                    x + grid_len,
-                    y,
-                    ambient_darkness_alpha,
-                    light_sources,
-                    2);
-                const u8 a2 = get_ambient_light_at_position( // bottom right
-                    x + grid_len,
-                    y + grid_len,
-                    ambient_darkness_alpha,
-                    light_sources,
-                    2);
-                const u8 a3 = get_ambient_light_at_position( // bottom left
-                    x,
-                    y + grid_len,
-                    ambient_darkness_alpha,
-                    light_sources,
-                    2);
-                if(a0 == a1 && a0 == a2 && a0 == a3) {
-                    const SDL_FRect rect = (SDL_FRect) {x, y, grid_len, grid_len};
-                    SDL_SetRenderDrawColor(r, 0, 0, 0, a0);
-                    SDL_RenderFillRectF(r, &rect);
-                }
-                else {
-                    const SDL_Vertex verts[] = {
-                        {(SDL_FPoint){x, y}, (SDL_Color){0,0,0,a0},(SDL_FPoint){0}}, // top left
-                        {(SDL_FPoint){x+grid_len, y},(SDL_Color){0,0,0,a1},(SDL_FPoint){0}}, // top right
-                        {(SDL_FPoint){x+grid_len, y+grid_len},(SDL_Color){0,0,0,a2},(SDL_FPoint){0}}, // bottom right
-                        {(SDL_FPoint){x, y+grid_len},(SDL_Color){0,0,0,a3},(SDL_FPoint){0}}, // bottom right
-                    };
-                    SDL_RenderGeometry(r, NULL, verts, 4, indicies, 6);
+    // evaluate the light field once per lattice vertex
+    const int *mask_indices = NULL;
+    u32 mask_index_count = 0;
+    // without bins the mask keeps the previous frame's contents
+    bool mask_update = true;
+    prof_zone("scene4_light_lattice") {
+        if(!file_lights) {
+            light_soa_load(&light_soa, light_sources, light_source_count);
+            if(mask_mode != MASK_MODE_ACCUMULATE) {
+                prof_zone("scene4_light_binning") {
+                    mask_update = light_bins_build(&light_bins, &light_soa);
                 }
             }
+        }
+        if(!mask_update) {
+            // the lattice no longer matches its previous lights
+            lattice.valid = false;
+        } else if(mask_mode == MASK_MODE_ACCUMULATE) {
+            if(!accumulate_mesh_static) {
+                build_accumulate_mesh(file_lights ? file_lights : &light_soa, ambient_darkness_alpha);
+                accumulate_mesh_static = file_lights != NULL;
+            }
+        } else if(mask_mode == MASK_MODE_PIXELS) {
+            DLE_MaskPixelsJob job = { .ambient_alpha = ambient_darkness_alpha };
+            void *pixels;
+            if(SDL_LockTexture(light_mask_pixels, NULL, &pixels, &job.pitch) == 0) {
+                job.pixels = pixels;
+                workers_parallel_for(mask_height(), 8, eval_mask_pixel_rows, &job);
+                SDL_UnlockTexture(light_mask_pixels);
+            }
+        } else if(mask_mode == MASK_MODE_ADAPTIVE) {
+            build_adaptive_mesh(ambient_darkness_alpha);
+        } else {
+            mask_indices = update_lattice(
+                &lattice, &light_bins, light_sources, clock, ambient_darkness_alpha, &mask_index_count);
+        }
+    }
 
+    // add light to mask. The lattice and adaptive meshes cover the whole
+    // target so there is no separate ambient clear. The pixel mask is
+    // already complete. The meshes are referenced, they stay untouched until
+    // the flush.
+    if(mask_update && mask_mode != MASK_MODE_PIXELS) {
+        prof_zone("scene4_mask_geometry") {
+            if(mask_mode == MASK_MODE_ACCUMULATE) {
+                const u8 ambient_light = 255 - ambient_darkness_alpha;
+                commands_fill(
+                    LAYER_MASK, light_mask, SDL_BLENDMODE_NONE, NULL,
+                    accumulate_min
+                        ? (SDL_Color){0, 0, 0, ambient_darkness_alpha}
+                        : (SDL_Color){ambient_light, ambient_light, ambient_light, 255});
+                commands_geometry_ref(
+                    LAYER_MASK, light_mask, accumulate_min ? light_mask_blend : SDL_BLENDMODE_ADD,
+                    accumulate_mesh.verts, accumulate_mesh.vert_count,
+                    accumulate_mesh.indices, accumulate_mesh.index_count);
+            } else if(mask_mode == MASK_MODE_ADAPTIVE) {
+                commands_geometry_ref(
+                    LAYER_MASK, light_mask, SDL_BLENDMODE_NONE,
+                    adaptive_mesh.verts, adaptive_mesh.vert_count,
+                    adaptive_mesh.indices, adaptive_mesh.index_count);
+            } else if(mask_index_count) {
+                commands_geometry_ref(
+                    LAYER_MASK, light_mask, SDL_BLENDMODE_NONE,
+                    lattice.verts, light_mask_vert_count,
+                    mask_indices, mask_index_count);
+            }
         }
     }
 
     // apply light mask to sceen
-    reset_render_state();
-    SDL_SetTextureBlendMode(light_mask, SDL_BLENDMODE_BLEND);
-    SDL_RenderCopyF(r, light_mask, NULL, NULL);
+    prof_zone("scene4_mask_composite") {
+        SDL_Texture *mask = mask_mode == MASK_MODE_PIXELS ? light_mask_pixels : light_mask;
+        // the light map scales the scene by its light
+        const SDL_BlendMode blend = mask_mode == MASK_MODE_ACCUMULATE && !accumulate_min
+            ? SDL_BLENDMODE_MOD : SDL_BLENDMODE_BLEND;
+        commands_copy(LAYER_COMPOSITE, NULL, blend, mask, NULL);
+    }
+
+    commands_flush();
+
+    prof_zone("scene4_present") {
+        SDL_RenderPresent(r);
+    }
+}
+
 
-    SDL_RenderPresent(r);
+static u32 count_bits(DLE_LatticeRowMask mask) {
+    u32 n = 0;
+    for(; mask; mask &= mask - 1)
+        n++;
+    return n;
+}
+
+bool scene_4_self_test(void) {
+    /* Returns true if incremental lattice updates leave the mask exactly as
+       a full rebuild would. Drives a lattice of its own with a few extra
+       lights plus a moving and a resizing light, with a skipped frame now
+       and then. The persistent mask is emulated per cell: every submitted
+       cell takes its corner alphas from the vertices, the others keep what
+       earlier frames drew.
+    */
+    // few enough extra lights that most vertices stay clean from frame to frame
+    const u32 frames = 600, light_count = 2 + 24;
+    const u8 ambient_alpha = ambient_darkness_alpha;
+    DLE_Lattice test_lattice = {0};
+    DLE_LightSoA soa = {0};
+    DLE_LightBins bins = {0};
+    DLE_LightSource *lights = calloc(light_count, sizeof(DLE_LightSource));
+    u8 *full_alphas = malloc(light_mask_vert_count);
+    u8 (*mask)[4] = malloc(sizeof(*mask) * lattice_cols * lattice_rows);
+    bool ok = lights && full_alphas && mask
+        && light_soa_reserve(&soa, light_count)
+        && light_bins_init(&bins, WINDOW_WIDTH, WINDOW_HEIGHT, LIGHT_TILE_SIZE)
+        && lattice_init(&test_lattice, light_count, true);
+    if(!ok)
+        fprintf(stderr, "%s failed to allocate the lattice\n", __func__);
+    DLE_FrameClock clock = {0};
+    u32 incremental_frames = 0, dirty_vertices = 0;
+    for(u32 frame = 0; frame < frames && ok; frame++) {
+        clock.frame_ix += frame % 97 == 0 ? 2 : 1;
+        clock.now = clock.frame_ix * 16;
+        const f32 angle = clock.now * 0.002f;
+        lights[0] = (DLE_LightSource) {
+            .position = (SDL_FPoint){ WINDOW_WIDTH * 0.5f + cosf(angle) * 500, WINDOW_HEIGHT * 0.5f + sinf(angle) * 300 },
+            .radius_squared = pow2(250),
+            .min_alpha = 40,
+        };
+        lights[1] = (DLE_LightSource) {
+            .position = (SDL_FPoint){ 300, 200 },
+            .radius_squared = pow2(F32(100 + (frame * 7) % 300)),
+            .min_alpha = U8(frame % 200),
+        };
+        update_extra_lights(lights, light_count, clock.now, 5, 220);
+        light_soa_load(&soa, lights, light_count);
+        if(!light_bins_build(&bins, &soa)) {
+            ok = false;
+            break;
+        }
+        u32 index_count;
+        const int *indices = update_lattice(&test_lattice, &bins, lights, &clock, ambient_alpha, &index_count);
+        const bool full = indices == test_lattice.indices;
+        for(u32 i = 0; i < index_count; i += 6) {
+            // top left, top right, bottom right, -, -, bottom left
+            const u32 top_left = U32(indices[i]);
+            u8 *cell = mask[top_left / lattice_stride * lattice_cols + top_left % lattice_stride];
+            cell[0] = test_lattice.verts[indices[i]].color.a;
+            cell[1] = test_lattice.verts[indices[i + 1]].color.a;
+            cell[2] = test_lattice.verts[indices[i + 2]].color.a;
+            cell[3] = test_lattice.verts[indices[i + 5]].color.a;
+        }
+
+        for(u32 row = 0; row <= lattice_rows; row++) {
+            light_bins_eval_row(
+                &bins, 0, lattice_grid_len, row * lattice_grid_len,
+                lattice_stride, ambient_alpha, &full_alphas[row * lattice_stride]);
+        }
+        for(u32 vert = 0; vert < light_mask_vert_count && ok; vert++) {
+            if(test_lattice.alphas[vert] == full_alphas[vert])
+                continue;
+            fprintf(stderr, "%s frame %u lattice vertex (%u, %u) is %u, full rebuild %u\n",
+                __func__, clock.frame_ix, vert % lattice_stride, vert / lattice_stride,
+                test_lattice.alphas[vert], full_alphas[vert]);
+            ok = false;
+        }
+        for(u32 cell = 0; cell < lattice_cols * lattice_rows && ok; cell++) {
+            const u32 top_left = cell / lattice_cols * lattice_stride + cell % lattice_cols;
+            const u32 corners[4] = {
+                top_left, top_left + 1, top_left + lattice_stride + 1, top_left + lattice_stride
+            };
+            for(u32 i = 0; i < 4; i++) {
+                if(mask[cell][i] == full_alphas[corners[i]])
+                    continue;
+                fprintf(stderr, "%s frame %u mask cell (%u, %u) corner %u is %u, full rebuild %u\n",
+                    __func__, clock.frame_ix, cell % lattice_cols, cell / lattice_cols, i,
+                    mask[cell][i], full_alphas[corners[i]]);
+                ok = false;
+                break;
+            }
+        }
+        if(full)
+            continue;
+        incremental_frames++;
+        for(u32 row = 0; row <= lattice_rows; row++)
+            dirty_vertices += count_bits(test_lattice.dirty[row]);
+    }
+    if(ok && !incremental_frames) {
+        fprintf(stderr, "%s no frame was updated incrementally\n", __func__);
+        ok = false;
+    }
+    if(ok)
+        printf("  %u of %u frames updated incrementally, %.1f%% of their vertices re-evaluated\n",
+            incremental_frames, frames, dirty_vertices * 100.0 / (incremental_frames * light_mask_vert_count));
+    lattice_free(&test_lattice);
+    light_bins_free(&bins);
+    light_soa_free(&soa);
+    free(mask);
+    free(full_alphas);
+    free(lights);
+    return ok;
 }
@@ -6,18 +6,14 @@
 #include <stdbool.h>
 
 #include "common.h"
+#include "lightfield.h"
 
 
 bool scene_4_setup(void);
 void scene_4_cleanup(void);
-void scene_4_draw(void);
-
-
-typedef struct {
-    SDL_FPoint position;
-    f32 radius_squared;
-    u8 min_alpha; // (max liminocity)
-} DLE_LightSource;
+void scene_4_draw(const DLE_FrameClock *clock);
+// self-test hook (see selftest.h): incremental lattice updates against full rebuilds.
+bool scene_4_self_test(void);
 
 #endif
 
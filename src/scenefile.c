@@ -0,0 +1,270 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scenefile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DLE_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+static DLE_SceneFile file = {0};
+static bool file_open = false;
+static void *file_data = NULL;
+static size_t file_size = 0;
+
+static bool map_file(const char *path) {
+    // sets file_data/file_size. Platforms without mmap read the file instead.
+#ifdef DLE_HAVE_MMAP
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "%s could not open %s\n", __func__, path);
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+        fprintf(stderr, "%s could not stat %s\n", __func__, path);
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        fprintf(stderr, "%s could not map %s\n", __func__, path);
+        return false;
+    }
+    file_data = data;
+    file_size = (size_t)st.st_size;
+#else
+    file_data = SDL_LoadFile(path, &file_size);
+    if(!file_data) {
+        fprintf(stderr, "%s could not read %s: %s\n", __func__, path, SDL_GetError());
+        return false;
+    }
+#endif
+    return true;
+}
+
+static void unmap_file(void) {
+    if(!file_data)
+        return;
+#ifdef DLE_HAVE_MMAP
+    munmap(file_data, file_size);
+#else
+    SDL_free(file_data);
+#endif
+    file_data = NULL;
+    file_size = 0;
+}
+
+static bool array_valid(const u64 offset, const u32 count, const size_t element_size) {
+    return offset % SCENE_FILE_ALIGN == 0
+        && offset <= file_size
+        && U64(count) * element_size <= file_size - offset;
+}
+
+bool scene_file_open(const char *path) {
+#if SDL_BYTEORDER != SDL_LIL_ENDIAN
+    fprintf(stderr, "%s scene files are little-endian only\n", __func__);
+    return false;
+#endif
+    scene_file_close();
+    if(!map_file(path))
+        return false;
+    const DLE_SceneFileHeader *header = file_data;
+    if(file_size < sizeof(DLE_SceneFileHeader)
+        || memcmp(header->magic, SCENE_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "%s %s is not a scene file\n", __func__, path);
+        unmap_file();
+        return false;
+    }
+    if(header->version != SCENE_FILE_VERSION || header->header_size != sizeof(DLE_SceneFileHeader)) {
+        fprintf(stderr, "%s %s has unsupported version %u\n", __func__, path, header->version);
+        unmap_file();
+        return false;
+    }
+    const u32 lights = header->light_count;
+    if(header->file_size != file_size
+        || !array_valid(header->light_x, lights, sizeof(f32))
+        || !array_valid(header->light_y, lights, sizeof(f32))
+        || !array_valid(header->light_radius_squared, lights, sizeof(f32))
+        || !array_valid(header->light_inv_radius_squared, lights, sizeof(f32))
+        || !array_valid(header->light_min_alpha, lights, sizeof(u8))
+        || !array_valid(header->segments, header->segment_count, sizeof(DLE_Segment))) {
+        fprintf(stderr, "%s %s is truncated or corrupt\n", __func__, path);
+        unmap_file();
+        return false;
+    }
+    u8 *base = file_data;
+    file = (DLE_SceneFile) {
+        .header = header,
+        .lights = {
+            .x = (f32 *)(base + header->light_x),
+            .y = (f32 *)(base + header->light_y),
+            .radius_squared = (f32 *)(base + header->light_radius_squared),
+            .inv_radius_squared = (f32 *)(base + header->light_inv_radius_squared),
+            .min_alpha = base + header->light_min_alpha,
+            .count = lights,
+            .capacity = lights,
+        },
+        .segments = (const DLE_Segment *)(base + header->segments),
+        .segment_count = header->segment_count,
+    };
+    file_open = true;
+    return true;
+}
+
+const DLE_SceneFile *scene_file(void) {
+    return file_open ? &file : NULL;
+}
+
+void scene_file_close(void) {
+    unmap_file();
+    file = (DLE_SceneFile) {0};
+    file_open = false;
+}
+
+/* Converter */
+
+static bool write_array(FILE *out, u64 *offset, const void *data, const size_t size) {
+    // pads out to SCENE_FILE_ALIGN, then writes data. offset is the file
+    // position, on return the array's offset.
+    static const u8 zeros[SCENE_FILE_ALIGN] = {0};
+    const u64 pad = (SCENE_FILE_ALIGN - *offset % SCENE_FILE_ALIGN) % SCENE_FILE_ALIGN;
+    if(pad && fwrite(zeros, 1, pad, out) != pad)
+        return false;
+    *offset += pad;
+    return !size || fwrite(data, 1, size, out) == size;
+}
+
+bool scene_file_convert(const char *text_path, const char *out_path) {
+#if SDL_BYTEORDER != SDL_LIL_ENDIAN
+    fprintf(stderr, "%s scene files are little-endian only\n", __func__);
+    return false;
+#endif
+    FILE *in = fopen(text_path, "r");
+    if(!in) {
+        fprintf(stderr, "%s could not open %s\n", __func__, text_path);
+        return false;
+    }
+    DLE_LightSource *sources = NULL;
+    u32 source_count = 0, source_capacity = 0;
+    DLE_LightSoA lights = {0};
+    DLE_Occluders occluders = {0};
+    FILE *out = NULL;
+    bool ok = false;
+
+    char line[256];
+    u32 line_number = 0;
+    while(fgets(line, sizeof(line), in)) {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if(comment)
+            *comment = '\0';
+        char kind[16];
+        f32 v[4];
+        int alpha;
+        if(sscanf(line, "%15s", kind) != 1)
+            continue;
+        if(strcmp(kind, "light") == 0
+            && sscanf(line, "%*s %f %f %f %d", &v[0], &v[1], &v[2], &alpha) == 4
+            && v[2] > 0 && alpha >= 0 && alpha <= 255) {
+            if(source_count == source_capacity) {
+                const u32 capacity = source_capacity ? source_capacity * 2 : 1024;
+                DLE_LightSource *grown = realloc(sources, sizeof(DLE_LightSource) * capacity);
+                if(!grown) {
+                    fprintf(stderr, "%s failed to grow to %u lights\n", __func__, capacity);
+                    goto done;
+                }
+                sources = grown;
+                source_capacity = capacity;
+            }
+            sources[source_count++] = (DLE_LightSource) {
+                .position = (SDL_FPoint) {v[0], v[1]},
+                .radius_squared = pow2(v[2]),
+                .min_alpha = U8(alpha),
+            };
+        } else if(strcmp(kind, "segment") == 0
+            && sscanf(line, "%*s %f %f %f %f", &v[0], &v[1], &v[2], &v[3]) == 4) {
+            if(!occluders_add_segment(&occluders, (SDL_FPoint) {v[0], v[1]}, (SDL_FPoint) {v[2], v[3]}))
+                goto done;
+        } else if(strcmp(kind, "rect") == 0
+            && sscanf(line, "%*s %f %f %f %f", &v[0], &v[1], &v[2], &v[3]) == 4
+            && v[2] > 0 && v[3] > 0) {
+            const SDL_FRect rect = {v[0], v[1], v[2], v[3]};
+            if(!occluders_add_rect(&occluders, &rect))
+                goto done;
+        } else {
+            fprintf(stderr, "%s %s line %u is invalid\n", __func__, text_path, line_number);
+            goto done;
+        }
+    }
+    if(ferror(in)) {
+        fprintf(stderr, "%s could not read %s\n", __func__, text_path);
+        goto done;
+    }
+    // the same conversion scenes apply to their lights every frame
+    if(!light_soa_reserve(&lights, source_count))
+        goto done;
+    light_soa_load(&lights, sources, source_count);
+
+    out = fopen(out_path, "wb");
+    if(!out) {
+        fprintf(stderr, "%s could not create %s\n", __func__, out_path);
+        goto done;
+    }
+    DLE_SceneFileHeader header = {
+        .version = SCENE_FILE_VERSION,
+        .header_size = sizeof(DLE_SceneFileHeader),
+        .light_count = lights.count,
+        .segment_count = occluders.count,
+    };
+    memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+    // the header is rewritten with the offsets once the arrays are out
+    u64 offset = sizeof(header);
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+    const struct {
+        u64 *offset;
+        const void *data;
+        size_t size;
+    } arrays[] = {
+        { &header.light_x, lights.x, sizeof(f32) * lights.count },
+        { &header.light_y, lights.y, sizeof(f32) * lights.count },
+        { &header.light_radius_squared, lights.radius_squared, sizeof(f32) * lights.count },
+        { &header.light_inv_radius_squared, lights.inv_radius_squared, sizeof(f32) * lights.count },
+        { &header.light_min_alpha, lights.min_alpha, sizeof(u8) * lights.count },
+        { &header.segments, occluders.segments, sizeof(DLE_Segment) * occluders.count },
+    };
+    for(u32 i = 0; written && i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        written = write_array(out, &offset, arrays[i].data, arrays[i].size);
+        *arrays[i].offset = offset;
+        offset += arrays[i].size;
+    }
+    // pad the end too, so the last array is a whole number of blocks
+    written = written && write_array(out, &offset, NULL, 0);
+    header.file_size = offset;
+    written = written && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+    if(fclose(out) != 0 || !written) {
+        fprintf(stderr, "%s could not write %s\n", __func__, out_path);
+        goto done;
+    }
+    out = NULL;
+    printf("%s: %u lights, %u segments, %llu bytes\n",
+        out_path, lights.count, occluders.count, (unsigned long long)header.file_size);
+    ok = true;
+
+    done:
+    if(out)
+        fclose(out);
+    fclose(in);
+    free_and_null(sources);
+    light_soa_free(&lights);
+    occluders_free(&occluders);
+    return ok;
+}
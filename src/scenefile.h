@@ -0,0 +1,67 @@
+#ifndef lighting_example_scenefile_H
+#define lighting_example_scenefile_H
+
+#include <stdbool.h>
+
+#include "common.h"
+#include "lightfield.h"
+#include "occluders.h"
+
+
+/* Binary scene files (SCENE_FILE=path).
+   A little-endian header followed by SCENE_FILE_ALIGN aligned arrays: the
+   lights as structure-of-arrays, exactly the DLE_LightSoA layout, and the
+   occluder segments as DLE_Segment (x1 y1 x2 y2). The file is memory mapped
+   read-only and the arrays are used in place, nothing is parsed or copied
+   on load. Offsets are from the start of the file.
+
+   Scene files are written by the converter from a text description, one
+   entry per line, '#' starts a comment:
+
+     light   x y radius min_alpha
+     segment x1 y1 x2 y2
+     rect    x y w h
+
+   min_alpha must not exceed the ambient alpha of the scene using the file,
+   scene 4 refuses files with darker lights (its ambient alpha is 235).
+*/
+
+#define SCENE_FILE_MAGIC "DLESCENE"
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_ALIGN 64
+
+typedef struct {
+    char magic[8];
+    u32 version;
+    u32 header_size;
+    u64 file_size;
+    u32 light_count;
+    u32 segment_count;
+    u64 light_x;                  // f32[light_count]
+    u64 light_y;                  // f32[light_count]
+    u64 light_radius_squared;     // f32[light_count]
+    u64 light_inv_radius_squared; // f32[light_count]
+    u64 light_min_alpha;          // u8[light_count]
+    u64 segments;                 // DLE_Segment[segment_count]
+} DLE_SceneFileHeader;
+
+_Static_assert(sizeof(DLE_SceneFileHeader) == 80, "scene file header must be packed");
+_Static_assert(sizeof(DLE_Segment) == 16, "scene file segments must be 4 f32");
+
+typedef struct {
+    const DLE_SceneFileHeader *header;
+    DLE_LightSoA lights;    // views into the mapping, read-only
+    const DLE_Segment *segments;
+    u32 segment_count;
+} DLE_SceneFile;
+
+// Maps and validates path as the scene file. Returns false on failure.
+bool scene_file_open(const char *path);
+// the open scene file, NULL if there is none.
+const DLE_SceneFile *scene_file(void);
+void scene_file_close(void);
+
+// Converts a text description into a binary scene file.
+bool scene_file_convert(const char *text_path, const char *out_path);
+
+#endif
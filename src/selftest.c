@@ -0,0 +1,416 @@
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lightfield.h"
+#include "lightshapes.h"
+#include "occluders.h"
+#include "scene4.h"
+#include "selftest.h"
+#include "textures.h"
+
+
+static u32 rng_state = 1;
+
+static u32 rng_next(void) {
+    // xorshift32
+    u32 x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+static u32 rng_range(const u32 n) {
+    // [0, n)
+    return rng_next() % n;
+}
+
+static f32 rng_quarter(const u32 n) {
+    // [0, n) on the quarter pixel grid
+    return rng_range(n * 4) * 0.25f;
+}
+
+
+/* kernels: every supported kernel against the reference kernel.
+*/
+
+#define KERNEL_LIGHT_SETS 400
+#define KERNEL_ROWS_PER_SET 24
+#define KERNEL_MAX_LIGHTS 24
+#define KERNEL_MAX_SAMPLES 300
+
+static const char *tested_kernels[] = {"scalar", "fixed", "sse2", "avx2"};
+
+static void random_light_set(DLE_LightSource *lights, const u32 count, const u8 ambient_alpha) {
+    // half of the sets are packed into a small area, so most samples are
+    // covered by several lights at once.
+    const bool clustered = rng_range(2);
+    const f32 cx = rng_quarter(WINDOW_WIDTH), cy = rng_quarter(WINDOW_HEIGHT);
+    for(u32 i = 0; i < count; i++) {
+        const f32
+            x = clustered ? cx + rng_quarter(120) - 60 : rng_quarter(WINDOW_WIDTH),
+            y = clustered ? cy + rng_quarter(120) - 60 : rng_quarter(WINDOW_HEIGHT),
+            radius = 1 + rng_range(400);
+        lights[i] = (DLE_LightSource) {
+            .position = (SDL_FPoint){ x, y },
+            .radius_squared = pow2(radius),
+            .min_alpha = U8(rng_range(ambient_alpha + 1u)),
+        };
+    }
+}
+
+static void random_row(
+    const DLE_LightSource *lights, const u32 light_count,
+    f32 *x0, f32 *dx, f32 *y, u32 *count
+) {
+    // samples anywhere, or lined up with a light so they land exactly on its
+    // center and its left, right, top or bottom edge.
+    *count = 1 + rng_range(KERNEL_MAX_SAMPLES);
+    const u32 edge_case = light_count ? rng_range(4) : 0;
+    if(edge_case == 0) {
+        static const f32 steps[] = {0.25f, 1, 2.5f, 8, 64};
+        *dx = steps[rng_range(sizeof(steps) / sizeof(steps[0]))];
+        *x0 = rng_quarter(WINDOW_WIDTH) - (*count / 2) * *dx;
+        *y = rng_quarter(WINDOW_HEIGHT);
+        return;
+    }
+    const DLE_LightSource *light = &lights[rng_range(light_count)];
+    const f32 radius = sqrtf(light->radius_squared);
+    const u32 before = rng_range(*count);
+    if(edge_case == 1) {
+        // the row runs through the center, sampling left edge, center, right edge
+        *dx = radius;
+        *x0 = light->position.x - (before % 4) * radius;
+        *y = light->position.y;
+    } else {
+        // the row touches the top or bottom edge
+        *dx = 1 + rng_range(4) * 0.25f;
+        *x0 = light->position.x - before * *dx;
+        *y = light->position.y + (edge_case == 2 ? -radius : radius);
+    }
+}
+
+static bool check_kernels(void) {
+    DLE_LightSource lights[KERNEL_MAX_LIGHTS];
+    DLE_LightSoA soa = {0};
+    u8 expected[KERNEL_MAX_SAMPLES], actual[KERNEL_MAX_SAMPLES];
+    if(!light_soa_reserve(&soa, KERNEL_MAX_LIGHTS))
+        return false;
+    const u32 kernel_count = sizeof(tested_kernels) / sizeof(tested_kernels[0]);
+    u32 worst[sizeof(tested_kernels) / sizeof(tested_kernels[0])] = {0};
+    u64 samples = 0;
+    bool ok = true;
+    for(u32 set = 0; set < KERNEL_LIGHT_SETS && ok; set++) {
+        const u8 ambient_alpha = U8(rng_range(256));
+        const u32 light_count = rng_range(KERNEL_MAX_LIGHTS + 1);
+        random_light_set(lights, light_count, ambient_alpha);
+        light_soa_load(&soa, lights, light_count);
+        for(u32 row = 0; row < KERNEL_ROWS_PER_SET && ok; row++) {
+            f32 x0, dx, y;
+            u32 count;
+            random_row(lights, light_count, &x0, &dx, &y, &count);
+            light_field_select_kernel("reference");
+            light_field_eval_row(&soa, x0, dx, y, count, ambient_alpha, expected);
+            samples += count;
+            for(u32 k = 0; k < kernel_count && ok; k++) {
+                if(!light_field_kernel_supported(tested_kernels[k]))
+                    continue;
+                light_field_select_kernel(tested_kernels[k]);
+                light_field_eval_row(&soa, x0, dx, y, count, ambient_alpha, actual);
+                for(u32 i = 0; i < count; i++) {
+                    const u32 diff = abs(expected[i] - actual[i]);
+                    worst[k] = diff > worst[k] ? diff : worst[k];
+                    if(diff <= 1)
+                        continue;
+                    fprintf(stderr, "%s %s: sample (%f, %f) of set %u (%u lights, ambient %u) is %u, reference %u\n",
+                        __func__, tested_kernels[k], x0 + i * dx, y, set, light_count, ambient_alpha,
+                        actual[i], expected[i]);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+    }
+    light_soa_free(&soa);
+    for(u32 k = 0; k < kernel_count; k++) {
+        if(light_field_kernel_supported(tested_kernels[k]))
+            printf("  kernel %-6s worst difference %u over %llu samples\n",
+                tested_kernels[k], worst[k], (unsigned long long)samples);
+        else
+            printf("  kernel %-6s not supported, skipped\n", tested_kernels[k]);
+    }
+    return ok;
+}
+
+
+/* bins: light_bins_eval_row against light_field_eval_row over every light.
+*/
+
+#define BINS_LIGHT_SETS 24
+#define BINS_MAX_LIGHTS 3000
+#define BINS_TILE_SIZE 128
+
+static bool check_bins(void) {
+    DLE_LightSource *lights = malloc(sizeof(DLE_LightSource) * BINS_MAX_LIGHTS);
+    DLE_LightSoA soa = {0};
+    DLE_LightBins bins = {0};
+    u8 expected[WINDOW_WIDTH * 4], actual[WINDOW_WIDTH * 4];
+    bool ok = lights
+        && light_soa_reserve(&soa, BINS_MAX_LIGHTS)
+        && light_bins_init(&bins, WINDOW_WIDTH, WINDOW_HEIGHT, BINS_TILE_SIZE);
+    for(u32 set = 0; set < BINS_LIGHT_SETS && ok; set++) {
+        const u8 ambient_alpha = 235;
+        const u32 light_count = rng_range(BINS_MAX_LIGHTS + 1);
+        for(u32 i = 0; i < light_count; i++) {
+            // some lights sit beyond the window and reach into the edge tiles
+            lights[i] = (DLE_LightSource) {
+                .position = (SDL_FPoint){
+                    rng_quarter(WINDOW_WIDTH + 400) - 200, rng_quarter(WINDOW_HEIGHT + 400) - 200
+                },
+                .radius_squared = pow2(F32(1 + rng_range(400))),
+                .min_alpha = U8(rng_range(ambient_alpha + 1u)),
+            };
+        }
+        light_soa_load(&soa, lights, light_count);
+        if(!light_bins_build(&bins, &soa)) {
+            ok = false;
+            break;
+        }
+        for(u32 row = 0; row < 32 && ok; row++) {
+            // pixel centers, lattice vertices, tile borders and beyond the window
+            static const f32 steps[] = {0.25f, 0.5f, 1, 64};
+            const f32 dx = steps[rng_range(sizeof(steps) / sizeof(steps[0]))];
+            const u32 count = U32((WINDOW_WIDTH + 200) / dx) < WINDOW_WIDTH * 4
+                ? U32((WINDOW_WIDTH + 200) / dx) : WINDOW_WIDTH * 4;
+            const f32
+                x0 = -100 + (dx < 1 ? 0 : dx * 0.5f),
+                y = row % 4 == 0
+                    ? F32(rng_range(WINDOW_HEIGHT / BINS_TILE_SIZE + 1) * BINS_TILE_SIZE)
+                    : rng_quarter(WINDOW_HEIGHT + 200) - 100;
+            light_field_eval_row(&soa, x0, dx, y, count, ambient_alpha, expected);
+            light_bins_eval_row(&bins, x0, dx, y, count, ambient_alpha, actual);
+            for(u32 i = 0; i < count; i++) {
+                if(expected[i] == actual[i])
+                    continue;
+                fprintf(stderr, "%s sample (%f, %f) of set %u (%u lights) is %u binned, %u unbinned\n",
+                    __func__, x0 + i * dx, y, set, light_count, actual[i], expected[i]);
+                ok = false;
+                break;
+            }
+        }
+    }
+    light_bins_free(&bins);
+    light_soa_free(&soa);
+    free(lights);
+    return ok;
+}
+
+
+/* occluders: every cone or fan aimed at a wall comes back clipped to it.
+*/
+
+#define OCCLUDER_FANS 20000
+
+static bool check_occluders(void) {
+    // the cones of scenes 2 and 3 and 180 degree fans, the widest supported
+    const DLE_LightShape *shapes[] = {
+        light_shape_get(LIGHT_SHAPE_CONE, 2, 0.5f),
+        light_shape_get(LIGHT_SHAPE_CONE, 2, 1.0f),
+        light_shape_get(LIGHT_SHAPE_CONE, 8, 0.25f),
+        light_shape_get(LIGHT_SHAPE_FAN, 8, 90),
+        light_shape_get(LIGHT_SHAPE_FAN, 16, 180),
+    };
+    const u32 shape_count = sizeof(shapes) / sizeof(shapes[0]);
+    DLE_Occluders occluders = {0};
+    DLE_LightFans fans = {0};
+    SDL_FPoint points[LIGHT_SHAPE_MAX_POINTS];
+    bool ok = true;
+    for(u32 i = 0; i < shape_count; i++)
+        ok &= shapes[i] != NULL;
+    for(u32 i = 0; i < OCCLUDER_FANS && ok; i++) {
+        const DLE_LightShape *shape = shapes[i % shape_count];
+        const SDL_FPoint origin = { rng_quarter(WINDOW_WIDTH), rng_quarter(WINDOW_HEIGHT) };
+        // every 8th light is axis aligned, like the scenes' lights
+        const f32
+            angle = i % 8 == 0 ? F32(rng_range(4) * 90) : rng_range(360 * 64) / 64.0f,
+            length = F32(100 + rng_range(500)),
+            width = F32(20 + rng_range(300));
+        const DLE_LightXform xform = light_xform(origin, angle, width, length);
+        light_shape_transform(shape, &xform, points);
+
+        // a wall across the axis, wider than the light
+        const f32
+            ax = -xform.m01 / length,
+            ay = -xform.m11 / length,
+            wall_dist = length * (0.2f + rng_range(61) * 0.01f),
+            wall_half = width * 2 + 10;
+        const SDL_FPoint wall_mid = { origin.x + ax * wall_dist, origin.y + ay * wall_dist };
+        occluders_clear(&occluders);
+        light_fans_clear(&fans);
+        if(!occluders_add_segment(&occluders,
+                (SDL_FPoint){ wall_mid.x - ay * wall_half, wall_mid.y + ax * wall_half },
+                (SDL_FPoint){ wall_mid.x + ay * wall_half, wall_mid.y - ax * wall_half })
+            || !occluders_clip_fans(&occluders, points, shape->point_count, 1, &fans)) {
+            ok = false;
+            break;
+        }
+
+        if(fans.fan_count != 1) {
+            fprintf(stderr, "%s light %u (angle %f) lost its visible area\n", __func__, i, angle);
+            ok = false;
+            break;
+        }
+        f32 beyond = 0;
+        for(u32 p = fans.firsts[0] + 1; p < fans.firsts[1]; p++) {
+            const f32 along = (fans.points[p].x - origin.x) * ax + (fans.points[p].y - origin.y) * ay;
+            beyond = SDL_max(beyond, along - wall_dist);
+        }
+        if(beyond > length * 1e-3f) {
+            fprintf(stderr, "%s light %u (angle %f, %u points) reaches %f past the wall\n",
+                __func__, i, angle, shape->point_count, beyond);
+            ok = false;
+        }
+    }
+    light_fans_free(&fans);
+    occluders_free(&occluders);
+    occluders_sweep_free();
+    light_shapes_free();
+    return ok;
+}
+
+
+/* crossings: fans among crossing segments or boxes, every boundary edge of
+   the clipped fan lies on whatever a ray through its middle hits first.
+*/
+
+#define CROSSING_FANS 2000
+#define CROSSING_SEGMENTS 48
+
+static f64 ray_hit(
+    const SDL_FPoint o, const f64 dx, const f64 dy, const SDL_FPoint p, const SDL_FPoint q
+) {
+    // distance along (dx, dy) from o to the segment pq, INFINITY if the ray
+    // misses it.
+    const f64 ex = q.x - p.x, ey = q.y - p.y, wx = p.x - o.x, wy = p.y - o.y;
+    const f64 den = dx * ey - dy * ex;
+    if(fabs(den) < 1e-12)
+        return INFINITY;
+    const f64 t = (wx * ey - wy * ex) / den, u = (wx * dy - wy * dx) / den;
+    return t > 0 && u >= 0 && u <= 1 ? t : INFINITY;
+}
+
+static bool check_crossings(void) {
+    const DLE_LightShape *shapes[] = {
+        light_shape_get(LIGHT_SHAPE_CONE, 2, 0.5f),
+        light_shape_get(LIGHT_SHAPE_CONE, 8, 0.25f),
+        light_shape_get(LIGHT_SHAPE_FAN, 16, 180),
+    };
+    const u32 shape_count = sizeof(shapes) / sizeof(shapes[0]);
+    DLE_Occluders occluders = {0};
+    DLE_LightFans fans = {0};
+    SDL_FPoint points[LIGHT_SHAPE_MAX_POINTS];
+    bool ok = true;
+    for(u32 i = 0; i < shape_count; i++)
+        ok &= shapes[i] != NULL;
+    for(u32 i = 0; i < CROSSING_FANS && ok; i++) {
+        const DLE_LightShape *shape = shapes[i % shape_count];
+        const SDL_FPoint origin = { 200 + rng_quarter(600), 200 + rng_quarter(600) };
+        const f32
+            angle = rng_range(360 * 64) / 64.0f,
+            length = F32(100 + rng_range(500)),
+            width = F32(20 + rng_range(300));
+        const DLE_LightXform xform = light_xform(origin, angle, width, length);
+        light_shape_transform(shape, &xform, points);
+        occluders_clear(&occluders);
+        light_fans_clear(&fans);
+        // every other light among boxes, which only meet at their corners
+        for(u32 s = 0; s < CROSSING_SEGMENTS && ok; s += i % 2 ? 4 : 1) {
+            const SDL_FPoint a = { rng_quarter(1000), rng_quarter(1000) };
+            if(i % 2) {
+                const SDL_FRect rect = { a.x, a.y, F32(4 + rng_range(120)), F32(4 + rng_range(80)) };
+                ok = occluders_add_rect(&occluders, &rect);
+            } else {
+                ok = occluders_add_segment(&occluders, a, (SDL_FPoint){ rng_quarter(1000), rng_quarter(1000) });
+            }
+        }
+        if(!ok || !occluders_clip_fans(&occluders, points, shape->point_count, 1, &fans)) {
+            ok = false;
+            break;
+        }
+
+        for(u32 f = 0; f < fans.fan_count && ok; f++) {
+            for(u32 p = fans.firsts[f] + 1; p + 1 < fans.firsts[f + 1]; p++) {
+                const SDL_FPoint p0 = fans.points[p], p1 = fans.points[p + 1];
+                const f64
+                    mx = (p0.x + p1.x) * 0.5 - origin.x,
+                    my = (p0.y + p1.y) * 0.5 - origin.y,
+                    reach = sqrt(mx * mx + my * my),
+                    dx = mx / reach, dy = my / reach,
+                    ex = p1.x - p0.x, ey = p1.y - p0.y;
+                // along edges the ray only grazes, a rounding error in the
+                // points is a large error in reach
+                if(fabs(dx * ey - dy * ex) < 0.01 * sqrt(ex * ex + ey * ey))
+                    continue;
+                f64 nearest = INFINITY;
+                for(u32 e = 1; e + 1 < shape->point_count; e++)
+                    nearest = SDL_min(nearest, ray_hit(origin, dx, dy, points[e], points[e + 1]));
+                for(u32 s = 0; s < occluders.count; s++)
+                    nearest = SDL_min(nearest, ray_hit(origin, dx, dy, occluders.segments[s].a, occluders.segments[s].b));
+                if(fabs(reach - nearest) > 0.05 + reach * 1e-4) {
+                    fprintf(stderr, "%s light %u (angle %f) edge %u at %f, nearest is at %f\n",
+                        __func__, i, angle, p - fans.firsts[f], reach, nearest);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+    }
+    light_fans_free(&fans);
+    occluders_free(&occluders);
+    occluders_sweep_free();
+    light_shapes_free();
+    return ok;
+}
+
+
+bool self_test_run(void) {
+    // Returns true if every check passed.
+    {
+        const char *seed_data = getenv("SELF_TEST_SEED");
+        rng_state = seed_data ? U32(strtoul(seed_data, NULL, 0)) : 1;
+        if(!rng_state) {
+            fprintf(stderr, "SELF_TEST_SEED env variable is invalid\n");
+            return false;
+        }
+    }
+    printf("self-test seed: %u\n", rng_state);
+
+    const struct {
+        const char *name;
+        bool (*run)(void);
+    } checks[] = {
+        {"kernels", check_kernels},
+        {"bins", check_bins},
+        {"lattice", scene_4_self_test},
+        {"textures", textures_self_test},
+        {"occluders", check_occluders},
+        {"crossings", check_crossings},
+    };
+    u32 failed = 0;
+    for(u32 i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        printf("%s\n", checks[i].name);
+        const char *kernel = light_field_kernel_name();
+        const bool ok = checks[i].run();
+        // checks may switch kernels
+        light_field_select_kernel(kernel);
+        printf("%s: %s\n", checks[i].name, ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    if(failed)
+        fprintf(stderr, "self-test: %u of %u checks failed\n", failed, U32(sizeof(checks) / sizeof(checks[0])));
+    else
+        printf("self-test: ok\n");
+    return !failed;
+}
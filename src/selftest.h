@@ -0,0 +1,32 @@
+
+#ifndef lighting_example_selftest_H
+#define lighting_example_selftest_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+
+/* Self-test (lighting self-test, ./build.sh test).
+   Checks the optimized paths against the code they replaced, on seeded
+   random inputs (SELF_TEST_SEED) plus the edge cases each one is prone to:
+     kernels    every supported light kernel against the reference kernel,
+                within 1 alpha step
+     bins       binned rows against unbinned rows, identical
+     lattice    scene 4's incremental lattice updates and the mask cells
+                they redraw against full rebuilds, identical
+     textures   the brick wall generator against the original fills
+     occluders  cones and fans aimed at a wall, at any angle, come back
+                clipped to it
+     crossings  clipped fans among crossing segments and boxes against the
+                nearest occluder along rays through their edges
+   Random lights and samples sit on a quarter pixel grid with radii below
+   512, so a distance close to a light's radius is exact in single precision
+   and every kernel agrees on which lights cover a sample. The edge is a
+   hard cutoff, a rounding difference there is not a kernel difference.
+   Runs without a window or renderer. Returns false if any check failed.
+*/
+
+bool self_test_run(void);
+
+#endif
@@ -0,0 +1,121 @@
+
+#include "stats.h"
+
+
+static u64 ring[STATS_RING_SIZE];
+static SDL_atomic_t ring_head; // written by the render thread only
+static SDL_atomic_t ring_tail; // written by the reporter thread only
+static SDL_atomic_t dropped_frames;
+
+static SDL_Thread *reporter = NULL;
+static SDL_sem *stop_signal = NULL;
+static u32 interval_ms = STATS_DEFAULT_REPORT_INTERVAL_MS;
+static FILE *log_file = NULL;
+
+static u64 frames_total = 0;
+static u64 dropped_total = 0;
+static u64 first_frame_ts = 0;
+static u64 last_frame_ts = 0;
+
+void stats_push_frame(const u64 timestamp) {
+    const u32
+        head = U32(SDL_AtomicGet(&ring_head)),
+        tail = U32(SDL_AtomicGet(&ring_tail));
+    if(head - tail >= STATS_RING_SIZE) {
+        // reporter fell behind, never block the render thread.
+        SDL_AtomicAdd(&dropped_frames, 1);
+        return;
+    }
+    ring[head & (STATS_RING_SIZE - 1)] = timestamp;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ring_head, I32(head + 1));
+}
+
+static u32 drain_ring(void) {
+    // Returns the number of frames consumed.
+    const u32 head = U32(SDL_AtomicGet(&ring_head));
+    SDL_MemoryBarrierAcquire();
+    u32 tail = U32(SDL_AtomicGet(&ring_tail));
+    const u32 count = head - tail;
+    for(; tail != head; tail++) {
+        const u64 ts = ring[tail & (STATS_RING_SIZE - 1)];
+        if(!frames_total)
+            first_frame_ts = ts;
+        last_frame_ts = ts;
+        frames_total++;
+    }
+    SDL_AtomicSet(&ring_tail, I32(tail));
+    return count;
+}
+
+static inline char get_loading_char(const u32 report_ix) {
+    char working_chars[] = {'|', '/', '-', '\\'};
+    return working_chars[report_ix % sizeof(working_chars)];
+}
+
+static int reporter_main(void *data) {
+    const f64 freq = F64(SDL_GetPerformanceFrequency());
+    u64 window_start = SDL_GetPerformanceCounter();
+    u32 report_ix = 0;
+    // SemWaitTimeout returns 0 once stats_stop signals.
+    while(SDL_SemWaitTimeout(stop_signal, interval_ms) != 0) {
+        // dropped frames were still rendered, count them towards the FPS.
+        const u32 dropped = U32(SDL_AtomicSet(&dropped_frames, 0));
+        dropped_total += dropped;
+        const u32 frames = drain_ring() + dropped;
+        const u64 now = SDL_GetPerformanceCounter();
+        const f64 fps = frames / (F64(now - window_start) / freq);
+        window_start = now;
+        if(log_file) {
+            fprintf(log_file, "fps %.1f frames %u\n", fps, frames);
+            fflush(log_file);
+        } else {
+            printf("%c current FPS: %.0f  \r", get_loading_char(report_ix++), fps);
+            fflush(stdout);
+        }
+    }
+    drain_ring();
+    return 0;
+}
+
+bool stats_start(const u32 report_interval_ms, FILE *log_out) {
+    // Returns true if the reporter thread is running.
+    interval_ms = report_interval_ms;
+    log_file = log_out;
+    frames_total = 0;
+    dropped_total = 0;
+    SDL_AtomicSet(&ring_head, 0);
+    SDL_AtomicSet(&ring_tail, 0);
+    SDL_AtomicSet(&dropped_frames, 0);
+
+    stop_signal = SDL_CreateSemaphore(0);
+    if(!stop_signal) {
+        fprintf(stderr, "%s failed to create semaphore %s\n", __func__, SDL_GetError());
+        return false;
+    }
+    reporter = SDL_CreateThread(reporter_main, "stats_reporter", NULL);
+    if(!reporter) {
+        fprintf(stderr, "%s failed to create thread %s\n", __func__, SDL_GetError());
+        SDL_DestroySemaphore(stop_signal);
+        stop_signal = NULL;
+        return false;
+    }
+    return true;
+}
+
+void stats_stop(void) {
+    if(!reporter)
+        return;
+    SDL_SemPost(stop_signal);
+    SDL_WaitThread(reporter, NULL);
+    reporter = NULL;
+    SDL_DestroySemaphore(stop_signal);
+    stop_signal = NULL;
+
+    dropped_total += U32(SDL_AtomicSet(&dropped_frames, 0));
+    const f64 elapsed = F64(last_frame_ts - first_frame_ts) / F64(SDL_GetPerformanceFrequency());
+    if(frames_total > 1 && elapsed > 0)
+        printf("\navg FPS: %f\n", (frames_total + dropped_total - 1) / elapsed);
+    if(dropped_total)
+        printf("stats ring overflowed, %lu frames were counted without timestamps\n", (unsigned long)dropped_total);
+}
@@ -0,0 +1,25 @@
+
+#ifndef lighting_example_stats_H
+#define lighting_example_stats_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "common.h"
+
+
+/* Asynchronous frame statistics.
+   The render thread pushes one timestamp per frame into a single-producer/
+   single-consumer lock-free ring. A reporter thread drains the ring and
+   prints the FPS every report interval, so the render loop never does I/O.
+*/
+
+#define STATS_RING_SIZE 4096 // must be a power of 2
+#define STATS_DEFAULT_REPORT_INTERVAL_MS 250
+
+// log_out = NULL reports to stdout on a single, overwritten line.
+bool stats_start(const u32 report_interval_ms, FILE *log_out);
+void stats_push_frame(const u64 timestamp);
+void stats_stop(void);
+
+#endif
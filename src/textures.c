@@ -0,0 +1,375 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "textures.h"
+#include "workers.h"
+
+
+typedef struct {
+    const char *key;
+    SDL_Texture *texture;
+    u32 refs;
+    u64 bytes;
+} DLE_TextureEntry;
+
+static DLE_TextureEntry entries[TEXTURES_MAX];
+
+static u64 texture_bytes(SDL_Texture *texture) {
+    Uint32 format;
+    int width, height;
+    if(SDL_QueryTexture(texture, &format, NULL, &width, &height) != 0)
+        return 0;
+    return U64(width) * U64(height) * SDL_BYTESPERPIXEL(format);
+}
+
+SDL_Texture *texture_acquire(const char *key, DLE_TextureCreate create) {
+    DLE_TextureEntry *free_entry = NULL;
+    for(u32 i = 0; i < TEXTURES_MAX; i++) {
+        DLE_TextureEntry *entry = &entries[i];
+        if(entry->refs && strcmp(entry->key, key) == 0) {
+            entry->refs++;
+            return entry->texture;
+        }
+        if(!entry->refs && !free_entry)
+            free_entry = entry;
+    }
+    if(!free_entry) {
+        fprintf(stderr, "%s registry is full, can't add %s\n", __func__, key);
+        return NULL;
+    }
+    SDL_Texture *texture = create();
+    if(!texture) {
+        fprintf(stderr, "%s failed to create %s\n", __func__, key);
+        return NULL;
+    }
+    *free_entry = (DLE_TextureEntry) {
+        .key = key,
+        .texture = texture,
+        .refs = 1,
+        .bytes = texture_bytes(texture),
+    };
+    return texture;
+}
+
+void texture_release(SDL_Texture *texture) {
+    if(!texture)
+        return;
+    for(u32 i = 0; i < TEXTURES_MAX; i++) {
+        DLE_TextureEntry *entry = &entries[i];
+        if(!entry->refs || entry->texture != texture)
+            continue;
+        if(--entry->refs == 0) {
+            SDL_DestroyTexture(entry->texture);
+            *entry = (DLE_TextureEntry) {0};
+        }
+        return;
+    }
+    fprintf(stderr, "%s texture is not in the registry\n", __func__);
+}
+
+u64 textures_resident_bytes(void) {
+    u64 bytes = 0;
+    for(u32 i = 0; i < TEXTURES_MAX; i++)
+        bytes += entries[i].refs ? entries[i].bytes : 0;
+    return bytes;
+}
+
+u32 textures_resident_count(void) {
+    u32 count = 0;
+    for(u32 i = 0; i < TEXTURES_MAX; i++)
+        count += entries[i].refs ? 1 : 0;
+    return count;
+}
+
+/* Procedural textures are generated on the CPU into a pixel buffer and
+   uploaded once. Generated pixels are cached as BMP files in the cache
+   directory, named after the generator and a hash of its parameters.
+*/
+
+static char *cache_dir = NULL;
+
+bool textures_init_cache(const char *dir) {
+    free_and_null(cache_dir);
+    if(dir && !dir[0])
+        return true;
+    if(dir) {
+        cache_dir = malloc(strlen(dir) + 2);
+        if(!cache_dir) {
+            fprintf(stderr, "%s failed to allocate the cache path\n", __func__);
+            return false;
+        }
+        strcpy(cache_dir, dir);
+        if(dir[strlen(dir) - 1] != '/')
+            strcat(cache_dir, "/");
+        return true;
+    }
+    char *pref_path = SDL_GetPrefPath("sdl-dynamic-lighting", "lighting");
+    if(!pref_path) {
+        // not fatal, generate every time
+        fprintf(stderr, "%s no texture cache: %s\n", __func__, SDL_GetError());
+        return true;
+    }
+    cache_dir = malloc(strlen(pref_path) + 1);
+    if(cache_dir)
+        strcpy(cache_dir, pref_path);
+    SDL_free(pref_path);
+    return true;
+}
+
+void textures_shutdown_cache(void) {
+    free_and_null(cache_dir);
+}
+
+static u32 hash_params(const void *params, const size_t size) {
+    // FNV-1a
+    const u8 *bytes = params;
+    u32 hash = 2166136261u;
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+static bool cache_path(char *path, const size_t len, const char *name, const DLE_TextureParams *params) {
+    // returns false if caching is disabled.
+    if(!cache_dir)
+        return false;
+    const int n = snprintf(
+        path, len, "%s%s_%ux%u_%08x.bmp",
+        cache_dir, name, params->width, params->height, hash_params(params, sizeof(*params)));
+    return n > 0 && U32(n) < len;
+}
+
+static SDL_Texture *upload_pixels(const void *pixels, const int pitch, const u32 width, const u32 height) {
+    SDL_Texture *texture = SDL_CreateTexture(
+        r,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STATIC,
+        I32(width), I32(height));
+    if(!texture) {
+        fprintf(stderr, "%s failed to create texture %s", __func__, SDL_GetError());
+        return NULL;
+    }
+    if(SDL_UpdateTexture(texture, NULL, pixels, pitch) != 0) {
+        fprintf(stderr, "%s failed to upload texture %s", __func__, SDL_GetError());
+        SDL_DestroyTexture(texture);
+        return NULL;
+    }
+    return texture;
+}
+
+static SDL_Texture *cache_load(const char *path, const DLE_TextureParams *params) {
+    // returns NULL on a cache miss.
+    SDL_Surface *loaded = SDL_LoadBMP(path);
+    if(!loaded)
+        return NULL;
+    SDL_Texture *texture = NULL;
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA8888, 0);
+    SDL_FreeSurface(loaded);
+    if(surface && U32(surface->w) == params->width && U32(surface->h) == params->height) {
+        SDL_LockSurface(surface);
+        texture = upload_pixels(surface->pixels, surface->pitch, params->width, params->height);
+        SDL_UnlockSurface(surface);
+    }
+    SDL_FreeSurface(surface);
+    return texture;
+}
+
+static void cache_store(const char *path, u32 *pixels, const DLE_TextureParams *params) {
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        pixels, I32(params->width), I32(params->height), 32, I32(params->width * 4),
+        SDL_PIXELFORMAT_RGBA8888);
+    if(!surface || SDL_SaveBMP(surface, path) != 0)
+        fprintf(stderr, "%s failed to write %s: %s\n", __func__, path, SDL_GetError());
+    SDL_FreeSurface(surface);
+}
+
+typedef struct {
+    const DLE_TextureParams *params;
+    u32 *pixels; // RGBA8888, width * height
+} DLE_TextureJob;
+
+static SDL_Texture *create_procedural(
+    const char *name,
+    const DLE_TextureParams *params,
+    DLE_WorkerJob generate_rows
+) {
+    // generate_rows is a worker job over pixel rows, ctx is a DLE_TextureJob.
+    char path[1024];
+    const bool cached = cache_path(path, sizeof(path), name, params);
+    if(cached) {
+        SDL_Texture *texture = cache_load(path, params);
+        if(texture) {
+            printf("%s: loaded %s\n", name, path);
+            return texture;
+        }
+    }
+
+    const u64 start = SDL_GetPerformanceCounter();
+    // pixels no fill touches stay transparent, like a fresh render target.
+    u32 *pixels = calloc(params->width * params->height, sizeof(u32));
+    if(!pixels) {
+        fprintf(stderr, "%s failed to allocate %s pixels\n", __func__, name);
+        return NULL;
+    }
+    DLE_TextureJob job = { params, pixels };
+    workers_parallel_for(params->height, 16, generate_rows, &job);
+    SDL_Texture *texture = upload_pixels(pixels, I32(params->width * 4), params->width, params->height);
+    printf("%s: generated in %.2f ms\n",
+        name, (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+    if(texture && cached)
+        cache_store(path, pixels, params);
+    free(pixels);
+    return texture;
+}
+
+static inline u32 rgba(const u32 cr, const u32 cg, const u32 cb, const u32 ca) {
+    return cr << 24 | cg << 16 | cb << 8 | ca;
+}
+
+static inline void fill_span(
+    u32 *row, const u32 width, const i32 x, const i32 span_w, const u32 color
+) {
+    // fills [x, x + span_w) clipped to the row.
+    const i32 x1 = x < 0 ? 0 : x;
+    const i32 x2 = x + span_w > I32(width) ? I32(width) : x + span_w;
+    for(i32 i = x1; i < x2; i++)
+        row[i] = color;
+}
+
+typedef struct {
+    i32 x, y, w, h;
+    u32 color;
+} DLE_BrickFill;
+
+#define BRICK_CELL_FILLS 3
+
+static void brick_cell_fills(
+    const DLE_TextureParams *params, const i32 x, const i32 y,
+    DLE_BrickFill fills[BRICK_CELL_FILLS]
+) {
+    /* The fills of the cell at (x, y) in drawing order: the brick, the mortar
+       line below it reaching half the mortar into its neighbours, the mortar
+       joint right of it. Every other row is offset by half a cell.
+    */
+    const i32
+        cell_w = I32(params->cell_w),
+        cell_h = I32(params->cell_h),
+        mortar = I32(params->mortar),
+        brick_w = cell_w - mortar,
+        brick_h = cell_h - mortar,
+        offset_x = (y / cell_h) % 2 == 0 ? 0 : cell_w / 2,
+        bx = x + offset_x;
+    const u32 mortar_color = rgba(200, 200, 200, 255);
+    fills[0] = (DLE_BrickFill){ bx, y, brick_w, brick_h, rgba(120 + (x + y) % 40, 80 + (x * y) % 30, 60, 255) };
+    fills[1] = (DLE_BrickFill){ bx - mortar / 2, y + brick_h, brick_w + mortar / 2 * 2, mortar, mortar_color };
+    fills[2] = (DLE_BrickFill){ bx + brick_w, y, mortar, cell_h, mortar_color };
+}
+
+static void generate_brick_wall_rows(void *ctx, const u32 begin, const u32 end) {
+    /* Brick pattern, rows [begin, end). Every row replays the fills of the
+       cell row it falls into in drawing order, so later fills (mortar) win
+       exactly like the original render target version did.
+    */
+    const DLE_TextureJob *job = ctx;
+    const DLE_TextureParams *params = job->params;
+    const i32 cell_w = I32(params->cell_w), cell_h = I32(params->cell_h);
+    for(u32 py = begin; py < end; py++) {
+        u32 *row = &job->pixels[py * params->width];
+        const i32 y = I32(py) / cell_h * cell_h;
+        for(i32 x = 0; x < I32(params->width); x += cell_w) {
+            DLE_BrickFill fills[BRICK_CELL_FILLS];
+            brick_cell_fills(params, x, y, fills);
+            for(u32 i = 0; i < BRICK_CELL_FILLS; i++) {
+                if(I32(py) >= fills[i].y && I32(py) < fills[i].y + fills[i].h)
+                    fill_span(row, params->width, fills[i].x, fills[i].w, fills[i].color);
+            }
+        }
+    }
+}
+
+static const DLE_TextureParams brick_wall_params = {
+    .version = 1,
+    .width = BRICK_WALL_WIDTH,
+    .height = BRICK_WALL_HEIGHT,
+    .cell_w = 60,
+    .cell_h = 40,
+    .mortar = 5,
+};
+
+SDL_Texture *texture_create_brick_wall(void) {
+    return create_procedural(TEXTURE_KEY_BRICK_WALL, &brick_wall_params, generate_brick_wall_rows);
+}
+
+SDL_Texture *texture_create_mask_target(void) {
+    return mask_texture_create(SDL_TEXTUREACCESS_TARGET);
+}
+
+SDL_Texture *texture_create_mask_pixels(void) {
+    return mask_texture_create(SDL_TEXTUREACCESS_STREAMING);
+}
+
+
+static void fill_rect(
+    u32 *pixels, const u32 width, const u32 height, const DLE_BrickFill *fill
+) {
+    // SDL_RenderFillRect into a pixel buffer.
+    const i32 y1 = fill->y < 0 ? 0 : fill->y;
+    const i32 y2 = fill->y + fill->h > I32(height) ? I32(height) : fill->y + fill->h;
+    for(i32 py = y1; py < y2; py++)
+        fill_span(&pixels[py * width], width, fill->x, fill->w, fill->color);
+}
+
+bool textures_self_test(void) {
+    /* Returns true if the brick wall generator matches the original render
+       target version, its fills replayed cell by cell in the same order, for
+       the wall's parameters and a few others (odd mortar, cells that don't
+       divide the texture).
+    */
+    const DLE_TextureParams param_sets[] = {
+        brick_wall_params,
+        { .version = 1, .width = 500, .height = 300, .cell_w = 60, .cell_h = 40, .mortar = 4 },
+        { .version = 1, .width = 257, .height = 131, .cell_w = 33, .cell_h = 17, .mortar = 3 },
+        { .version = 1, .width = 64, .height = 64, .cell_w = 9, .cell_h = 6, .mortar = 1 },
+    };
+    bool ok = true;
+    for(u32 set = 0; set < sizeof(param_sets) / sizeof(param_sets[0]) && ok; set++) {
+        const DLE_TextureParams *params = &param_sets[set];
+        const u32 width = params->width, height = params->height;
+        u32 *pixels = calloc(width * height, sizeof(u32));
+        u32 *expected = calloc(width * height, sizeof(u32));
+        if(!pixels || !expected) {
+            fprintf(stderr, "%s failed to allocate pixels\n", __func__);
+            free(pixels);
+            free(expected);
+            return false;
+        }
+        DLE_TextureJob job = { params, pixels };
+        workers_parallel_for(height, 16, generate_brick_wall_rows, &job);
+        for(i32 y = 0; y < I32(height); y += I32(params->cell_h)) {
+            for(i32 x = 0; x < I32(width); x += I32(params->cell_w)) {
+                DLE_BrickFill fills[BRICK_CELL_FILLS];
+                brick_cell_fills(params, x, y, fills);
+                for(u32 i = 0; i < BRICK_CELL_FILLS; i++)
+                    fill_rect(expected, width, height, &fills[i]);
+            }
+        }
+        u32 mismatches = 0;
+        for(u32 i = 0; i < width * height; i++) {
+            if(pixels[i] == expected[i])
+                continue;
+            if(!mismatches)
+                fprintf(stderr, "%s set %u pixel (%u, %u) is %08x, expected %08x\n",
+                    __func__, set, i % width, i / width, pixels[i], expected[i]);
+            mismatches++;
+        }
+        if(mismatches) {
+            fprintf(stderr, "%s set %u: %u of %u pixels differ\n", __func__, set, mismatches, width * height);
+            ok = false;
+        }
+        free(pixels);
+        free(expected);
+    }
+    return ok;
+}
@@ -0,0 +1,63 @@
+#ifndef lighting_example_textures_H
+#define lighting_example_textures_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+
+/* Shared texture registry.
+   Textures are deduplicated by key and refcounted: the first acquire of a
+   key runs its create function, later acquires return the same texture and
+   the last release destroys it. Scenes are never drawn in the same frame,
+   so they share the window-sized mask render target (TEXTURE_KEY_MASK_TARGET)
+   and must not expect its contents to survive another scene's frame.
+*/
+
+#define TEXTURES_MAX 32
+#define TEXTURE_KEY_BRICK_WALL "brick_wall"
+#define TEXTURE_KEY_MASK_TARGET "mask_target"
+#define TEXTURE_KEY_MASK_PIXELS "mask_pixels"
+
+#define BRICK_WALL_WIDTH 500
+#define BRICK_WALL_HEIGHT 300
+
+// returns NULL on failure.
+typedef SDL_Texture *(*DLE_TextureCreate)(void);
+
+// returns NULL on failure.
+SDL_Texture *texture_acquire(const char *key, DLE_TextureCreate create);
+// NULL is ignored.
+void texture_release(SDL_Texture *texture);
+// bytes held by every live texture in the registry.
+u64 textures_resident_bytes(void);
+u32 textures_resident_count(void);
+
+/* Procedural texture parameters, also the disk cache key. Bump version when
+   a generator's output changes.
+*/
+typedef struct {
+    u32 version;
+    u32 width;
+    u32 height;
+    u32 cell_w;
+    u32 cell_h;
+    u32 mortar;
+} DLE_TextureParams;
+
+// dir = NULL caches in SDL's pref path, "" disables the cache.
+bool textures_init_cache(const char *dir);
+void textures_shutdown_cache(void);
+
+// shared create functions
+SDL_Texture *texture_create_brick_wall(void);
+SDL_Texture *texture_create_mask_target(void);
+// streaming, for masks the CPU writes per pixel.
+SDL_Texture *texture_create_mask_pixels(void);
+
+// self-test hook (see selftest.h): brick wall pixels against the original fills.
+bool textures_self_test(void);
+
+#define release_texture_and_null(ptr) if(ptr) { texture_release(ptr); ptr = NULL; }
+
+#endif
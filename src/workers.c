@@ -0,0 +1,201 @@
+
+#include "workers.h"
+
+
+// padded so that participants' ranges don't share a cache line.
+typedef struct {
+    SDL_SpinLock lock;
+    u32 begin;
+    u32 end;
+    u8 padding[64 - sizeof(SDL_SpinLock) - sizeof(u32) * 2];
+} DLE_WorkRange;
+
+static SDL_Thread *threads[WORKERS_MAX];
+static u32 thread_count = 0;
+static DLE_WorkRange ranges[WORKERS_MAX + 1]; // ranges[0] belongs to the caller
+
+static SDL_mutex *job_lock = NULL;
+static SDL_cond *job_ready = NULL;
+static u32 job_generation = 0;
+static bool job_quit = false;
+static DLE_WorkerJob job_fn = NULL;
+static void *job_ctx = NULL;
+static u32 job_grain = 1;
+static SDL_atomic_t job_pending;  // items not yet processed
+static SDL_atomic_t job_active;   // workers that joined the current job
+
+static inline void backoff(u32 *spins) {
+    // spin briefly, then give the core away in case we are oversubscribed.
+    if(++(*spins) < 256)
+        SDL_CompilerBarrier();
+    else
+        SDL_Delay(0);
+}
+
+static bool take_own(const u32 slot, u32 *begin, u32 *end) {
+    DLE_WorkRange *range = &ranges[slot];
+    SDL_AtomicLock(&range->lock);
+    const bool found = range->begin < range->end;
+    if(found) {
+        *begin = range->begin;
+        *end = range->begin + job_grain < range->end ? range->begin + job_grain : range->end;
+        range->begin = *end;
+    }
+    SDL_AtomicUnlock(&range->lock);
+    return found;
+}
+
+static bool steal(const u32 slot, const u32 participants) {
+    // Moves the back half of another participant's range into ours.
+    for(u32 i = 1; i < participants; i++) {
+        DLE_WorkRange *victim = &ranges[(slot + i) % participants];
+        SDL_AtomicLock(&victim->lock);
+        const u32 remaining = victim->end > victim->begin ? victim->end - victim->begin : 0;
+        if(!remaining) {
+            SDL_AtomicUnlock(&victim->lock);
+            continue;
+        }
+        const u32 stolen = remaining > job_grain ? remaining / 2 : remaining;
+        const u32 stolen_begin = victim->end - stolen, stolen_end = victim->end;
+        victim->end = stolen_begin;
+        SDL_AtomicUnlock(&victim->lock);
+
+        DLE_WorkRange *own = &ranges[slot];
+        SDL_AtomicLock(&own->lock);
+        own->begin = stolen_begin;
+        own->end = stolen_end;
+        SDL_AtomicUnlock(&own->lock);
+        return true;
+    }
+    return false;
+}
+
+static void run_job(const u32 slot, DLE_WorkerJob fn, void *ctx) {
+    const u32 participants = thread_count + 1;
+    for(;;) {
+        u32 begin, end;
+        while(take_own(slot, &begin, &end)) {
+            fn(ctx, begin, end);
+            SDL_AtomicAdd(&job_pending, -I32(end - begin));
+        }
+        if(!steal(slot, participants))
+            return;
+    }
+}
+
+static int worker_main(void *data) {
+    const u32 slot = U32((uintptr_t)data);
+    u32 seen_generation = 0;
+    for(;;) {
+        SDL_LockMutex(job_lock);
+        while(!job_quit && job_generation == seen_generation)
+            SDL_CondWait(job_ready, job_lock);
+        if(job_quit) {
+            SDL_UnlockMutex(job_lock);
+            return 0;
+        }
+        seen_generation = job_generation;
+        DLE_WorkerJob fn = job_fn;
+        void *ctx = job_ctx;
+        SDL_AtomicAdd(&job_active, 1);
+        SDL_UnlockMutex(job_lock);
+
+        run_job(slot, fn, ctx);
+        SDL_AtomicAdd(&job_active, -1);
+    }
+}
+
+bool workers_start(const u32 requested_thread_count) {
+    // Returns true if successful.
+    thread_count = 0;
+    job_quit = false;
+    if(!requested_thread_count)
+        return true;
+
+    job_lock = SDL_CreateMutex();
+    job_ready = SDL_CreateCond();
+    if(!job_lock || !job_ready) {
+        fprintf(stderr, "%s failed to create job signal %s\n", __func__, SDL_GetError());
+        return false;
+    }
+    const u32 count = requested_thread_count < WORKERS_MAX ? requested_thread_count : WORKERS_MAX;
+    for(u32 i = 0; i < count; i++) {
+        threads[i] = SDL_CreateThread(worker_main, "light_worker", (void*)(uintptr_t)(i + 1));
+        if(!threads[i]) {
+            fprintf(stderr, "%s failed to create thread %s\n", __func__, SDL_GetError());
+            return false;
+        }
+        thread_count++;
+    }
+    return true;
+}
+
+void workers_stop(void) {
+    if(job_lock) {
+        SDL_LockMutex(job_lock);
+        job_quit = true;
+        SDL_CondBroadcast(job_ready);
+        SDL_UnlockMutex(job_lock);
+    }
+    for(u32 i = 0; i < thread_count; i++) {
+        SDL_WaitThread(threads[i], NULL);
+        threads[i] = NULL;
+    }
+    thread_count = 0;
+    if(job_ready) {
+        SDL_DestroyCond(job_ready);
+        job_ready = NULL;
+    }
+    if(job_lock) {
+        SDL_DestroyMutex(job_lock);
+        job_lock = NULL;
+    }
+}
+
+u32 workers_participants(void) {
+    return thread_count + 1;
+}
+
+void workers_parallel_for(const u32 count, const u32 grain, DLE_WorkerJob job, void *ctx) {
+    if(!count)
+        return;
+    if(!thread_count || count <= grain) {
+        job(ctx, 0, count);
+        return;
+    }
+
+    SDL_LockMutex(job_lock);
+    // wait for workers that joined an already finished job to leave it, then
+    // the ranges are ours to reset. Late joiners only ever find empty ranges.
+    u32 spins = 0;
+    while(SDL_AtomicGet(&job_active) > 0) {
+        SDL_UnlockMutex(job_lock);
+        backoff(&spins);
+        SDL_LockMutex(job_lock);
+    }
+    const u32 participants = thread_count + 1;
+    const u32 share = count / participants, extra = count % participants;
+    u32 begin = 0;
+    for(u32 i = 0; i < participants; i++) {
+        const u32 end = begin + share + (i < extra ? 1 : 0);
+        SDL_AtomicLock(&ranges[i].lock);
+        ranges[i].begin = begin;
+        ranges[i].end = end;
+        SDL_AtomicUnlock(&ranges[i].lock);
+        begin = end;
+    }
+    SDL_AtomicSet(&job_pending, I32(count));
+    job_fn = job;
+    job_ctx = ctx;
+    job_grain = grain ? grain : 1;
+    job_generation++;
+    SDL_CondBroadcast(job_ready);
+    SDL_UnlockMutex(job_lock);
+
+    run_job(0, job, ctx);
+
+    // jobs are short, spin until the stragglers are done.
+    spins = 0;
+    while(SDL_AtomicGet(&job_pending) > 0)
+        backoff(&spins);
+}
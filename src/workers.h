@@ -0,0 +1,28 @@
+
+#ifndef lighting_example_workers_H
+#define lighting_example_workers_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+
+/* Persistent SDL_Thread worker pool.
+   workers_parallel_for splits [0, count) evenly between the workers and the
+   calling thread. Each participant drains its own range front to back in
+   `grain` sized chunks and, once empty, steals the back half of another
+   participant's range. The call returns when every chunk has run.
+*/
+
+#define WORKERS_MAX 64
+
+typedef void (*DLE_WorkerJob)(void *ctx, const u32 begin, const u32 end);
+
+// thread_count excludes the calling thread. 0 runs every job on the caller.
+bool workers_start(const u32 thread_count);
+void workers_stop(void);
+// number of threads that participate in a job, including the caller.
+u32 workers_participants(void);
+void workers_parallel_for(const u32 count, const u32 grain, DLE_WorkerJob job, void *ctx);
+
+#endif